@@ -2,38 +2,30 @@
 
 #include "constants.h"
 #include "config.h"
+#include "capture.h"
+#include "connection.h"
+#include "registry.h"
 #include "radio.h"
 #include "lightbar.h"
+#include "log.h"
+#include "metrics.h"
 #include "mqtt.h"
+#include "scheduler.h"
 
+WiFiConnection wifi(WIFI_SSID, WIFI_PASSWORD);
 WiFiClient wifiClient;
-Radio radio(RADIO_PIN_CE, RADIO_PIN_CSN);
-MQTT mqtt(&wifiClient, MQTT_SERVER, MQTT_PORT, MQTT_USER, MQTT_PASSWORD, MQTT_ROOT_TOPIC, HOME_ASSISTANT_DISCOVERY, HOME_ASSISTANT_DISCOVERY_PREFIX);
-
-void setupWifi()
-{
-  Serial.print("[WiFi] Connecting to network \"");
-  Serial.print(WIFI_SSID);
-  Serial.print("\"...");
-
-  WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
-  WiFi.setHostname(mqtt.getClientId().c_str());
-
-  uint retries = 0;
-  while (WiFi.status() != WL_CONNECTED)
-  {
-    delay(1000);
-    Serial.print(".");
-    retries++;
-    if (retries > 60)
-      ESP.restart();
-  }
-  Serial.println();
-  Serial.println("[WiFi] connected!");
-
-  Serial.print("[WiFi] IP address: ");
-  Serial.println(WiFi.localIP());
-}
+Registry registry;
+Scheduler scheduler;
+#ifdef RADIO_PIN_IRQ
+Radio radio(&registry, RADIO_PIN_CE, RADIO_PIN_CSN, RADIO_PIN_IRQ);
+#else
+Radio radio(&registry, RADIO_PIN_CE, RADIO_PIN_CSN);
+#endif
+MQTT mqtt(&registry, &scheduler, &wifiClient, MQTT_SERVER, MQTT_PORT, MQTT_USER, MQTT_PASSWORD, MQTT_ROOT_TOPIC, HOME_ASSISTANT_DISCOVERY, HOME_ASSISTANT_DISCOVERY_PREFIX);
+Metrics metrics(&radio, &mqtt, &wifi);
+#ifdef RF_CAPTURE
+Capture capture(&radio, &mqtt);
+#endif
 
 void setup()
 {
@@ -45,7 +37,8 @@ void setup()
 
   radio.setup();
 
-  setupWifi();
+  wifi.setEventHandler(MQTT::handleConnectionEvent, &mqtt);
+  wifi.setup(mqtt.getClientId().c_str());
 
   for (int i = 0; i < sizeof(REMOTES) / sizeof(SerialWithName); i++)
   {
@@ -60,16 +53,21 @@ void setup()
   }
 
   mqtt.setup();
+  metrics.setup();
+#ifdef RF_CAPTURE
+  capture.setup(RF_CAPTURE);
+#endif
 }
 
 void loop()
 {
-  if (!WiFi.isConnected())
-  {
-    Serial.println("[WiFi] connection lost!");
-    setupWifi();
-  }
-
+  wifi.loop();
   mqtt.loop();
   radio.loop();
+  scheduler.loop();
+  metrics.loop();
+#ifdef RF_CAPTURE
+  capture.loop();
+#endif
+  logger::loop();
 }
\ No newline at end of file
@@ -0,0 +1,72 @@
+#include "capture.h"
+#include "log.h"
+
+Capture::Capture(Radio *radio, MQTT *mqtt)
+{
+    this->radio = radio;
+    this->mqtt = mqtt;
+}
+
+Capture::~Capture()
+{
+    this->radio->setCaptureHandler(nullptr, nullptr);
+}
+
+void Capture::setup(CaptureMode mode)
+{
+    this->mode = mode;
+    this->topic = this->mqtt->getCombinedRootTopic() + "/capture";
+    this->radio->setCaptureHandler(mode == CAPTURE_OFF ? nullptr : Capture::onPackage, this);
+    logger::write(PSTR("[Capture] Capturing all received packages to %s!\n"), mode == CAPTURE_TO_MQTT ? this->topic.c_str() : "the console");
+}
+
+void Capture::loop()
+{
+    if (this->mode != CAPTURE_TO_MQTT || !this->mqtt->isConnected() || millis() - this->lastPublish < constants::CAPTURE_PUBLISH_INTERVAL)
+        return;
+    if (this->batchLength == 0 && this->dropped == 0)
+        return;
+
+    // The number of packages dropped since the previous message is added as the last line. It goes
+    // into the space onPackage() leaves free, and only becomes part of the batch if it was published.
+    size_t length = this->batchLength;
+    if (this->dropped > 0)
+    {
+        size_t space = sizeof(this->batch) - length;
+        int written = snprintf(this->batch + length, space, "dropped %u\n", this->dropped);
+        if (written > 0)
+            length += min((size_t)written, space - 1);
+    }
+    if (!this->mqtt->publish(this->topic.c_str(), (const byte *)this->batch, length, false))
+        return;
+    this->lastPublish = millis();
+    this->batchLength = 0;
+    this->dropped = 0;
+}
+
+void Capture::onPackage(void *capture, const RawPackage *package)
+{
+    Capture *self = (Capture *)capture;
+
+    char line[constants::CAPTURE_LINE_LENGTH];
+    int length = snprintf(line, sizeof(line), "%lu ", package->received_at);
+    for (size_t i = 0; i < sizeof(package->data); i++)
+        length += snprintf(line + length, sizeof(line) - length, "%02X", package->data[i]);
+
+    if (self->mode == CAPTURE_TO_SERIAL)
+    {
+        logger::write(PSTR("[Capture] %s\n"), line);
+        return;
+    }
+
+    // Nothing can be published without a connection, so the package only counts as dropped. There
+    // always is room left for the line with the number of dropped packages.
+    if (!self->mqtt->isConnected() || self->batchLength + length + 1 > sizeof(self->batch) - constants::CAPTURE_LINE_LENGTH)
+    {
+        self->dropped++;
+        return;
+    }
+    memcpy(self->batch + self->batchLength, line, length);
+    self->batchLength += length;
+    self->batch[self->batchLength++] = '\n';
+}
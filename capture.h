@@ -0,0 +1,43 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <Arduino.h>
+
+#include "constants.h"
+#include "mqtt.h"
+#include "radio.h"
+
+enum CaptureMode
+{
+    CAPTURE_OFF,
+    CAPTURE_TO_SERIAL,
+    CAPTURE_TO_MQTT
+};
+
+// Streams every raw package the radio receives, for debugging with real RF traffic. Each package is
+// written as one line with the time it was received in microseconds and its 18 bytes in hex.
+class Capture
+{
+public:
+    Capture(Radio *radio, MQTT *mqtt);
+    ~Capture();
+    void setup(CaptureMode mode);
+    void loop();
+
+private:
+    Radio *radio;
+    MQTT *mqtt;
+    CaptureMode mode = CAPTURE_OFF;
+    String topic;
+
+    // Packages for MQTT are collected here and published as one message at most every
+    // constants::CAPTURE_PUBLISH_INTERVAL. Packages that don't fit in between are dropped.
+    char batch[constants::CAPTURE_BATCH_SIZE * constants::CAPTURE_LINE_LENGTH];
+    size_t batchLength = 0;
+    uint32_t dropped = 0;
+    unsigned long lastPublish = 0;
+
+    static void onPackage(void *capture, const RawPackage *package);
+};
+
+#endif
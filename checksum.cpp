@@ -0,0 +1,5 @@
+#include "checksum.h"
+
+static_assert(checksum::generateCrc16Table(checksum::CRC16_POLYNOMIAL).values[1] == checksum::CRC16_POLYNOMIAL, "CRC16 table generation is broken");
+
+const checksum::Crc16Table checksum::CRC16_TABLE PROGMEM = checksum::generateCrc16Table(checksum::CRC16_POLYNOMIAL);
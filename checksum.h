@@ -0,0 +1,57 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stdint.h>
+#include <Arduino.h>
+
+namespace checksum
+{
+    // For details on how these parameters were chosen, see
+    // https://github.com/lamperez/xiaomi-lightbar-nrf24?tab=readme-ov-file#crc-checksum
+    const uint16_t CRC16_POLYNOMIAL = 0x1021;
+    const uint16_t CRC16_INIT = 0xfffe;
+
+    struct Crc16Table
+    {
+        uint16_t values[256];
+    };
+
+    constexpr Crc16Table generateCrc16Table(uint16_t polynomial)
+    {
+        Crc16Table table = {};
+        for (int i = 0; i < 256; i++)
+        {
+            uint16_t crc = i << 8;
+            for (int bit = 0; bit < 8; bit++)
+                crc = (crc & 0x8000) ? (crc << 1) ^ polynomial : crc << 1;
+            table.values[i] = crc;
+        }
+        return table;
+    }
+
+    // Lookup table for CRC16_POLYNOMIAL, generated at compile time and stored in flash.
+    extern const Crc16Table CRC16_TABLE;
+
+    // Calculates the CRC16 (no reflection, no final xor) of the given data. Pass the result of a
+    // previous call as crc to continue a checksum over several chunks.
+    inline uint16_t crc16(const byte *data, size_t length, uint16_t crc = CRC16_INIT)
+    {
+        for (size_t i = 0; i < length; i++)
+            crc = (crc << 8) ^ pgm_read_word(&CRC16_TABLE.values[((crc >> 8) ^ data[i]) & 0xFF]);
+        return crc;
+    }
+
+    const uint32_t FNV1A_OFFSET = 0x811c9dc5;
+    const uint32_t FNV1A_PRIME = 0x01000193;
+
+    // Calculates the 32 bit FNV-1a hash of the given data. Pass the result of a previous call as hash
+    // to continue a hash over several chunks.
+    inline uint32_t fnv1a(const byte *data, size_t length, uint32_t hash = FNV1A_OFFSET)
+    {
+        for (size_t i = 0; i < length; i++)
+            hash = (hash ^ data[i]) * FNV1A_PRIME;
+        return hash;
+    }
+};
+
+#endif
@@ -0,0 +1,203 @@
+#include "command.h"
+
+namespace
+{
+    const uint8_t MAX_DEPTH = 8;
+    const uint8_t MAX_NUMBER_LENGTH = 24;
+
+    class Parser
+    {
+    public:
+        Parser(const byte *payload, unsigned int length)
+        {
+            this->position = (const char *)payload;
+            this->end = (const char *)payload + length;
+        }
+
+        void skipWhitespace()
+        {
+            while (this->position < this->end && (*this->position == ' ' || *this->position == '\t' || *this->position == '\n' || *this->position == '\r'))
+                this->position++;
+        }
+
+        bool consume(char c)
+        {
+            this->skipWhitespace();
+            if (this->position >= this->end || *this->position != c)
+                return false;
+            this->position++;
+            return true;
+        }
+
+        bool peek(char c)
+        {
+            this->skipWhitespace();
+            return this->position < this->end && *this->position == c;
+        }
+
+        // Reads a string and returns its raw contents, escape sequences are left as they are.
+        bool readString(const char **start, unsigned int *length)
+        {
+            if (!this->consume('"'))
+                return false;
+            *start = this->position;
+            while (this->position < this->end && *this->position != '"')
+            {
+                if (*this->position == '\\' && this->end - this->position > 1)
+                    this->position++;
+                this->position++;
+            }
+            if (this->position >= this->end)
+                return false;
+            *length = this->position - *start;
+            this->position++;
+            return true;
+        }
+
+        bool readNumber(float *value)
+        {
+            this->skipWhitespace();
+            char buffer[MAX_NUMBER_LENGTH + 1];
+            uint8_t length = 0;
+            while (this->position < this->end && length < MAX_NUMBER_LENGTH &&
+                   ((*this->position >= '0' && *this->position <= '9') || *this->position == '-' || *this->position == '+' ||
+                    *this->position == '.' || *this->position == 'e' || *this->position == 'E'))
+                buffer[length++] = *this->position++;
+            buffer[length] = '\0';
+            if (length == 0)
+                return false;
+            char *numberEnd;
+            *value = strtod(buffer, &numberEnd);
+            return numberEnd == buffer + length;
+        }
+
+        bool readLiteral(const char *literal)
+        {
+            this->skipWhitespace();
+            size_t length = strlen(literal);
+            if ((size_t)(this->end - this->position) < length || strncmp(this->position, literal, length))
+                return false;
+            this->position += length;
+            return true;
+        }
+
+        bool skipValue(uint8_t depth)
+        {
+            if (depth > MAX_DEPTH)
+                return false;
+            this->skipWhitespace();
+            if (this->position >= this->end)
+                return false;
+
+            const char *start;
+            unsigned int length;
+            float number;
+            switch (*this->position)
+            {
+            case '"':
+                return this->readString(&start, &length);
+            case '{':
+                this->position++;
+                if (this->consume('}'))
+                    return true;
+                do
+                {
+                    if (!this->readString(&start, &length) || !this->consume(':') || !this->skipValue(depth + 1))
+                        return false;
+                } while (this->consume(','));
+                return this->consume('}');
+            case '[':
+                this->position++;
+                if (this->consume(']'))
+                    return true;
+                do
+                {
+                    if (!this->skipValue(depth + 1))
+                        return false;
+                } while (this->consume(','));
+                return this->consume(']');
+            case 't':
+                return this->readLiteral("true");
+            case 'f':
+                return this->readLiteral("false");
+            case 'n':
+                return this->readLiteral("null");
+            default:
+                return this->readNumber(&number);
+            }
+        }
+
+        bool atEnd()
+        {
+            this->skipWhitespace();
+            return this->position >= this->end;
+        }
+
+    private:
+        const char *position;
+        const char *end;
+    };
+
+    bool keyEquals(const char *key, unsigned int length, const char *expected)
+    {
+        return strlen(expected) == length && !strncmp(key, expected, length);
+    }
+
+    template <typename T>
+    T clampNumber(float value, T maximum)
+    {
+        if (!(value > 0))
+            return 0;
+        if (value >= maximum)
+            return maximum;
+        return (T)value;
+    }
+};
+
+bool parseLightbarCommand(const byte *payload, unsigned int length, LightbarCommand *command)
+{
+    *command = LightbarCommand();
+    Parser parser(payload, length);
+    if (!parser.consume('{'))
+        return false;
+    if (parser.consume('}'))
+        return parser.atEnd();
+
+    do
+    {
+        const char *key;
+        unsigned int keyLength;
+        if (!parser.readString(&key, &keyLength) || !parser.consume(':'))
+            return false;
+
+        float number;
+        if (keyEquals(key, keyLength, "state") && parser.peek('"'))
+        {
+            const char *state;
+            unsigned int stateLength;
+            if (!parser.readString(&state, &stateLength))
+                return false;
+            command->hasState = true;
+            command->state = keyEquals(state, stateLength, "ON");
+        }
+        else if (keyEquals(key, keyLength, "brightness") && !parser.peek('"') && parser.readNumber(&number))
+        {
+            command->hasBrightness = true;
+            command->brightness = clampNumber<uint8_t>(number, 255);
+        }
+        else if (keyEquals(key, keyLength, "color_temp") && !parser.peek('"') && parser.readNumber(&number))
+        {
+            command->hasColorTemp = true;
+            command->colorTemp = clampNumber<uint>(number, 65535);
+        }
+        else if (keyEquals(key, keyLength, "transition") && !parser.peek('"') && parser.readNumber(&number))
+        {
+            command->hasTransition = true;
+            command->transition = number > 0 ? number : 0;
+        }
+        else if (!parser.skipValue(1))
+            return false;
+    } while (parser.consume(','));
+
+    return parser.consume('}') && parser.atEnd();
+}
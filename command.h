@@ -0,0 +1,25 @@
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include <Arduino.h>
+
+// The fields of a light bar command as sent by Home Assistant's MQTT JSON schema, e.g.
+// {"state": "ON", "brightness": 15, "color_temp": 153, "transition": 2}
+struct LightbarCommand
+{
+    bool hasState = false;
+    bool state = false;
+    bool hasBrightness = false;
+    uint8_t brightness = 0;
+    bool hasColorTemp = false;
+    uint colorTemp = 0;
+    bool hasTransition = false;
+    float transition = 0;
+};
+
+// Parses a JSON command directly from the MQTT payload without allocating anything. Unknown keys
+// are skipped, including nested objects and arrays up to a fixed depth. Returns false if the payload
+// is not a well-formed JSON object.
+bool parseLightbarCommand(const byte *payload, unsigned int length, LightbarCommand *command);
+
+#endif
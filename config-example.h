@@ -7,6 +7,17 @@
 // The pin number to which the nRF24's Chip Select Null (CSN) pin is connected.
 #define RADIO_PIN_CSN 5
 
+// The pin number to which the nRF24's interrupt (IRQ) pin is connected. This is optional.
+// If set, the nRF24 is only read in loops where it signalled a received package. Otherwise it is polled
+// every loop. Leave commented out if the IRQ pin is not connected.
+// #define RADIO_PIN_IRQ 0
+
+// Streams every package received by the nRF24, including noise, for debugging. Each one is written with the
+// time it was received in microseconds and its raw 18 bytes in hex. Set to CAPTURE_TO_SERIAL to write them to
+// the console, or CAPTURE_TO_MQTT to publish them in batches to <root topic>/capture. Packages arriving faster
+// than they can be written are dropped and counted. Leave commented out for normal operation.
+// #define RF_CAPTURE CAPTURE_TO_SERIAL
+
 /* -- Light Bars ---------------------------------------------------------------------------------------------- */
 // All light bars that should be controlled by this controller. Each light bar must have a unique serial.
 // Each entry consists of the serial and the name of the light bar. By default, up to 10 light bars can be added.
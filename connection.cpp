@@ -0,0 +1,132 @@
+#include <ESP8266WiFi.h>
+
+#include "connection.h"
+#include "constants.h"
+#include "log.h"
+
+Backoff::Backoff(unsigned long initialDelay, unsigned long maximumDelay)
+{
+    this->initialDelay = initialDelay;
+    this->maximumDelay = maximumDelay;
+    this->nextDelay = initialDelay;
+}
+
+Backoff::~Backoff()
+{
+}
+
+void Backoff::reset()
+{
+    this->currentDelay = 0;
+    this->nextDelay = this->initialDelay;
+}
+
+void Backoff::failed()
+{
+    // Wait somewhere between the full and one and a half times the delay, so several controllers
+    // don't hammer the access point or broker in lockstep.
+    this->currentDelay = this->nextDelay + random(this->nextDelay / 2 + 1);
+    this->nextDelay = min(this->nextDelay * 2, this->maximumDelay);
+    this->failedAt = millis();
+}
+
+bool Backoff::isDue()
+{
+    return millis() - this->failedAt >= this->currentDelay;
+}
+
+unsigned long Backoff::getDelay()
+{
+    return this->currentDelay;
+}
+
+WiFiConnection::WiFiConnection(const char *ssid, const char *password)
+    : backoff(constants::RECONNECT_INITIAL_DELAY, constants::RECONNECT_MAXIMUM_DELAY)
+{
+    this->ssid = ssid;
+    this->password = password;
+}
+
+WiFiConnection::~WiFiConnection()
+{
+}
+
+void WiFiConnection::setup(const char *hostname)
+{
+    // Reconnecting is handled here, so the SDK must neither do it on its own nor write to flash.
+    WiFi.persistent(false);
+    WiFi.mode(WIFI_STA);
+    WiFi.setAutoReconnect(false);
+    WiFi.setHostname(hostname);
+    this->connect();
+}
+
+void WiFiConnection::loop()
+{
+    wl_status_t status = WiFi.status();
+    switch (this->state)
+    {
+    case CONNECTED:
+        if (status == WL_CONNECTED)
+            return;
+        LOG(WIFI, WARNING, "connection lost!");
+        this->state = WAITING;
+        this->backoff.reset();
+        this->emit(EVENT_WIFI_DISCONNECTED);
+        return;
+
+    case CONNECTING:
+        if (status == WL_CONNECTED)
+        {
+            LOG(WIFI, INFO, "connected! IP address: %s", WiFi.localIP().toString().c_str());
+            this->state = CONNECTED;
+            this->connects++;
+            this->backoff.reset();
+            this->emit(EVENT_WIFI_CONNECTED);
+            return;
+        }
+        if (status != WL_CONNECT_FAILED && status != WL_NO_SSID_AVAIL && status != WL_WRONG_PASSWORD &&
+            millis() - this->attemptStartedAt < constants::WIFI_CONNECT_TIMEOUT)
+            return;
+        WiFi.disconnect();
+        this->backoff.failed();
+        this->state = WAITING;
+        LOG(WIFI, WARNING, "Connection failed! status=%d trying again in %lu ms.", (int)status, this->backoff.getDelay());
+        return;
+
+    case WAITING:
+        if (this->backoff.isDue())
+            this->connect();
+        return;
+    }
+}
+
+bool WiFiConnection::isConnected()
+{
+    return this->state == CONNECTED;
+}
+
+void WiFiConnection::setEventHandler(ConnectionEventHandler handler, void *context)
+{
+    this->eventHandler = handler;
+    this->eventContext = context;
+}
+
+uint32_t WiFiConnection::getConnectCount()
+{
+    return this->connects;
+}
+
+void WiFiConnection::connect()
+{
+    LOG(WIFI, INFO, "Connecting to network \"%s\"...", this->ssid);
+    WiFi.begin(this->ssid, this->password);
+    this->attemptStartedAt = millis();
+    this->state = CONNECTING;
+}
+
+void WiFiConnection::emit(ConnectionEvent event)
+{
+    if (this->eventHandler != nullptr)
+        this->eventHandler(this->eventContext, event);
+}
@@ -0,0 +1,67 @@
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include <Arduino.h>
+
+enum ConnectionEvent
+{
+    EVENT_WIFI_CONNECTED,
+    EVENT_WIFI_DISCONNECTED
+};
+
+typedef void (*ConnectionEventHandler)(void *context, ConnectionEvent event);
+
+// Exponential backoff with jitter for reconnection attempts. Nothing waits here, callers just ask
+// whether the next attempt is due.
+class Backoff
+{
+public:
+    Backoff(unsigned long initialDelay, unsigned long maximumDelay);
+    ~Backoff();
+    void reset();
+    void failed();
+    bool isDue();
+    unsigned long getDelay();
+
+private:
+    unsigned long initialDelay;
+    unsigned long maximumDelay;
+    unsigned long currentDelay = 0;
+    unsigned long nextDelay;
+    unsigned long failedAt = 0;
+};
+
+// Keeps the WiFi connection up without ever blocking the loop.
+class WiFiConnection
+{
+public:
+    WiFiConnection(const char *ssid, const char *password);
+    ~WiFiConnection();
+    void setup(const char *hostname);
+    void loop();
+    bool isConnected();
+    void setEventHandler(ConnectionEventHandler handler, void *context);
+    uint32_t getConnectCount();
+
+private:
+    enum State
+    {
+        WAITING,
+        CONNECTING,
+        CONNECTED
+    };
+
+    const char *ssid;
+    const char *password;
+    State state = WAITING;
+    unsigned long attemptStartedAt = 0;
+    uint32_t connects = 0;
+    Backoff backoff;
+    ConnectionEventHandler eventHandler = nullptr;
+    void *eventContext = nullptr;
+
+    void connect();
+    void emit(ConnectionEvent event);
+};
+
+#endif
@@ -15,12 +15,86 @@ namespace constants
     // The maximum number of remotes that can be connected to the controller.
     const uint8_t MAX_REMOTES = 10;
 
-    // The maximum number of serials, the controller will be able to save latest package ids for.
-    // This should always >= MAX_REMOTES + MAX_LIGHTBARS.
-    const uint8_t MAX_SERIALS = 32;
+    // The number of slots in the serial registry. This must be a power of two and at least
+    // twice MAX_LIGHTBARS + MAX_REMOTES, so lookups stay short.
+    const uint8_t REGISTRY_SIZE = 64;
+
+    // The number of Home Assistant discovery messages whose hash is remembered in flash. Each light bar
+    // uses 2 and each remote uses 7 of them, the controller's diagnostics another 8.
+    const uint8_t DISCOVERY_CACHE_SIZE = 104;
+
+    // Home Assistant discovery messages are spread over several loops. Within one loop, no more
+    // messages are started once this many bytes were published or this many milliseconds passed.
+    const size_t DISCOVERY_BYTES_PER_LOOP = 1024;
+    const unsigned long DISCOVERY_TIME_PER_LOOP = 20;
 
     // The maximum number of command listeners that can be registered for a remote.
     const uint8_t MAX_COMMAND_LISTENERS = 10;
+
+    // Failed WiFi and MQTT connection attempts are retried after this many milliseconds. The delay
+    // doubles with every further failure, up to the maximum.
+    const unsigned long RECONNECT_INITIAL_DELAY = 1000;
+    const unsigned long RECONNECT_MAXIMUM_DELAY = 60000;
+
+    // A WiFi connection attempt is given up after this many milliseconds.
+    const unsigned long WIFI_CONNECT_TIMEOUT = 20000;
+
+    // Connecting to the MQTT broker blocks the loop, so it must not take longer than this many
+    // milliseconds to open the socket and this many seconds to receive the broker's answer.
+    const uint16_t MQTT_CONNECT_TIMEOUT = 2000;
+    const uint16_t MQTT_SOCKET_TIMEOUT = 5;
+
+    // The maximum number of tasks waiting in the scheduler at the same time.
+    const uint8_t MAX_SCHEDULED_TASKS = MAX_REMOTES + 4;
+
+    // A remote's action is reset this many milliseconds after its last event.
+    const unsigned long ACTION_CLEAR_DELAY = 200;
+
+    // Steps of a remote's knob in the same direction are combined into one turn, as long as no more
+    // than this many milliseconds pass between them.
+    const unsigned long ROTARY_AGGREGATION_WINDOW = 300;
+
+    // The number of bytes of log messages waiting to be written to the serial port. Must be a power of two.
+    const uint16_t LOG_BUFFER_SIZE = 2048;
+
+    // Longer log messages are cut off.
+    const uint8_t LOG_LINE_LENGTH = 160;
+
+    // Diagnostics are published every this many milliseconds.
+    const unsigned long METRICS_INTERVAL = 60000;
+
+    // The maximum length of the published diagnostics in bytes.
+    const size_t METRICS_PAYLOAD_SIZE = 1024;
+
+    // Whether the diagnostics are announced to Home Assistant as sensors.
+    const bool METRICS_DISCOVERY = true;
+
+    // Captured packages are published to MQTT in batches of up to this many packages, at most once
+    // every this many milliseconds. Each package takes one line of up to CAPTURE_LINE_LENGTH characters.
+    const uint8_t CAPTURE_BATCH_SIZE = 16;
+    const unsigned long CAPTURE_PUBLISH_INTERVAL = 250;
+    const uint8_t CAPTURE_LINE_LENGTH = 48;
+
+    // The maximum number of frames waiting to be transmitted by the radio.
+    const uint8_t MAX_QUEUED_FRAMES = 16;
+
+    // How often each frame is repeated on air. The light bar only reacts to some of them.
+    const uint8_t FRAME_REPEATS = 20;
+
+    // The pause between two repeats of a frame in microseconds.
+    const unsigned long FRAME_REPEAT_INTERVAL_US = 10000;
+
+    // The maximum number of received raw packages buffered until they are decoded.
+    // Remotes send each command 20 times in a row, while the nRF24 itself only buffers three packages.
+    // This must be a power of two, not larger than 128.
+    const uint8_t MAX_BUFFERED_PACKAGES = 32;
+
+    // The number of brightness and color temperature steps a light bar supports.
+    const uint8_t LIGHTBAR_STEPS = 15;
+
+    // After this many milliseconds the tracked brightness and color temperature of a light bar are
+    // no longer trusted, and the next change is sent as an absolute value again.
+    const unsigned long LIGHTBAR_RESYNC_INTERVAL = 600000;
 };
 
 struct SerialWithName
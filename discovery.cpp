@@ -0,0 +1,180 @@
+#include "checksum.h"
+#include "constants.h"
+#include "discovery.h"
+
+const char discovery::BASE_CONFIG[] PROGMEM = R"json({"schema":"json","o":{"name":"lightbar2mqtt","sw_version":"$V","support_url":"https://github.com/ebinf/lightbar2mqtt"},"~":"$R/$S","availability_topic":"$R/availability","dev":{"ids":"$I_$S","name":"$N","mdl":"$M","mf":"Xiaomi","sw":"lightbar2mqtt $V","sn":"$S"},)json";
+
+const char discovery::LIGHTBAR_CONFIG[] PROGMEM = R"json("supported_color_modes":["color_temp"],"brightness":true,"brightness_scale":15,"name":"Light bar","cmd_t":"~/command","uniq_id":"$I_$S_lightbar","max_mireds":370,"min_mireds":153,"p":"light","icon":"mdi:wall-sconce-flat"})json";
+
+const char discovery::PAIR_CONFIG[] PROGMEM = R"json("name":"Pair","cmd_t":"~/pair","uniq_id":"$I_$S_pair","p":"button"})json";
+
+const char discovery::REMOTE_CONFIG[] PROGMEM = R"json("name":"Remote","state_topic":"~/state","uniq_id":"$I_$S_remote","value_template":"{{ value }}","enabled_by_default":true,"entity_category":"diagnostic","icon":"mdi:gesture-double-tap"})json";
+
+const char discovery::ACTION_CONFIG[] PROGMEM = R"json("automation_type":"trigger","payload":"$A","subtype":"$A","type":"action","topic":"~/state","p":"device_automation"})json";
+
+const char discovery::DIAGNOSTICS_BASE_CONFIG[] PROGMEM = R"json({"o":{"name":"lightbar2mqtt","sw_version":"$V","support_url":"https://github.com/ebinf/lightbar2mqtt"},"~":"$R","availability_topic":"$R/availability","dev":{"ids":"$I","name":"$N","mdl":"$M","sw":"lightbar2mqtt $V","sn":"$I"},"stat_t":"~/diagnostics","entity_category":"diagnostic","p":"sensor",)json";
+
+const char discovery::UPTIME_CONFIG[] PROGMEM = R"json("name":"Uptime","val_tpl":"{{ value_json.uptime }}","unit_of_meas":"s","dev_cla":"duration","uniq_id":"$I_$S_uptime"})json";
+
+const char discovery::FREE_HEAP_CONFIG[] PROGMEM = R"json("name":"Free heap","val_tpl":"{{ value_json.heap.free }}","unit_of_meas":"B","dev_cla":"data_size","stat_cla":"measurement","uniq_id":"$I_$S_free_heap"})json";
+
+const char discovery::MAX_FREE_BLOCK_CONFIG[] PROGMEM = R"json("name":"Largest free heap block","val_tpl":"{{ value_json.heap.max_free_block }}","unit_of_meas":"B","dev_cla":"data_size","stat_cla":"measurement","uniq_id":"$I_$S_max_free_block"})json";
+
+const char discovery::PACKAGES_ACCEPTED_CONFIG[] PROGMEM = R"json("name":"Packages received","val_tpl":"{{ value_json.rx.accepted }}","stat_cla":"total_increasing","uniq_id":"$I_$S_packages_accepted"})json";
+
+const char discovery::CHECKSUM_FAILURES_CONFIG[] PROGMEM = R"json("name":"Checksum failures","val_tpl":"{{ value_json.rx.checksum_failures }}","stat_cla":"total_increasing","uniq_id":"$I_$S_checksum_failures"})json";
+
+const char discovery::FRAMES_SENT_CONFIG[] PROGMEM = R"json("name":"Frames sent","val_tpl":"{{ value_json.tx.frames_sent }}","stat_cla":"total_increasing","uniq_id":"$I_$S_frames_sent"})json";
+
+const char discovery::LOOP_TIME_CONFIG[] PROGMEM = R"json("name":"Longest loop","val_tpl":"{{ value_json.loop_time.max / 1000 }}","unit_of_meas":"ms","dev_cla":"duration","stat_cla":"measurement","uniq_id":"$I_$S_loop_time"})json";
+
+const char discovery::COMMAND_LATENCY_CONFIG[] PROGMEM = R"json("name":"Longest command latency","val_tpl":"{{ value_json.command_latency.max / 1000 }}","unit_of_meas":"ms","dev_cla":"duration","stat_cla":"measurement","uniq_id":"$I_$S_command_latency"})json";
+
+const char discovery::DIAGNOSTICS_MODEL[] PROGMEM = "lightbar2mqtt";
+
+const char discovery::LIGHTBAR_MODEL[] PROGMEM = "Mi Computer Monitor Light Bar (MJGJD01YL)";
+const char discovery::REMOTE_MODEL[] PROGMEM = "Mi Computer Monitor Light Bar Remote Control (MJGJD01YL)";
+
+namespace
+{
+    // Returns the value for a placeholder and whether it is stored in flash.
+    const char *placeholderValue(char placeholder, const discovery::Values &values, bool *inFlash)
+    {
+        *inFlash = false;
+        switch (placeholder)
+        {
+        case 'V':
+            return constants::VERSION.c_str();
+        case 'I':
+            return values.clientId;
+        case 'R':
+            return values.rootTopic;
+        case 'S':
+            return values.serial;
+        case 'N':
+            return values.name;
+        case 'M':
+            *inFlash = true;
+            return values.model;
+        case 'A':
+            return values.action;
+        default:
+            return nullptr;
+        }
+    }
+
+    class ChunkWriter
+    {
+    public:
+        ChunkWriter(Print *output)
+        {
+            this->output = output;
+        }
+
+        void write(char c)
+        {
+            this->buffer[this->length++] = c;
+            if (this->length == sizeof(this->buffer))
+                this->flush();
+        }
+
+        void flush()
+        {
+            if (this->length > 0)
+                this->written += this->output->write((const uint8_t *)this->buffer, this->length);
+            this->length = 0;
+        }
+
+        size_t getWritten()
+        {
+            return this->written;
+        }
+
+    private:
+        Print *output;
+        char buffer[64];
+        uint8_t length = 0;
+        size_t written = 0;
+    };
+
+    class HashWriter : public Print
+    {
+    public:
+        uint32_t hash;
+
+        HashWriter(uint32_t hash)
+        {
+            this->hash = hash;
+        }
+
+        size_t write(uint8_t c) override
+        {
+            this->hash = checksum::fnv1a(&c, 1, this->hash);
+            return 1;
+        }
+
+        size_t write(const uint8_t *buffer, size_t size) override
+        {
+            this->hash = checksum::fnv1a(buffer, size, this->hash);
+            return size;
+        }
+    };
+};
+
+size_t discovery::measure(PGM_P part, const Values &values)
+{
+    size_t length = 0;
+    for (size_t i = 0;; i++)
+    {
+        char c = pgm_read_byte(part + i);
+        if (c == '\0')
+            return length;
+        if (c != '$')
+        {
+            length++;
+            continue;
+        }
+
+        bool inFlash;
+        const char *value = placeholderValue(pgm_read_byte(part + ++i), values, &inFlash);
+        if (value != nullptr)
+            length += inFlash ? strlen_P(value) : strlen(value);
+    }
+}
+
+size_t discovery::render(Print *output, PGM_P part, const Values &values)
+{
+    ChunkWriter writer(output);
+    for (size_t i = 0;; i++)
+    {
+        char c = pgm_read_byte(part + i);
+        if (c == '\0')
+            break;
+        if (c != '$')
+        {
+            writer.write(c);
+            continue;
+        }
+
+        bool inFlash;
+        const char *value = placeholderValue(pgm_read_byte(part + ++i), values, &inFlash);
+        if (value == nullptr)
+            continue;
+        for (size_t j = 0;; j++)
+        {
+            char v = inFlash ? pgm_read_byte(value + j) : value[j];
+            if (v == '\0')
+                break;
+            writer.write(v);
+        }
+    }
+    writer.flush();
+    return writer.getWritten();
+}
+
+uint32_t discovery::hash(PGM_P part, const Values &values, uint32_t hash)
+{
+    HashWriter writer(hash);
+    discovery::render(&writer, part, values);
+    return writer.hash;
+}
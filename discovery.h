@@ -0,0 +1,54 @@
+#ifndef DISCOVERY_H
+#define DISCOVERY_H
+
+#include <Arduino.h>
+
+namespace discovery
+{
+    // Values filled into the placeholders of the templates below.
+    struct Values
+    {
+        const char *clientId;  // $I
+        const char *rootTopic; // $R
+        const char *serial;    // $S
+        const char *name;      // $N
+        const char *model;     // $M
+        const char *action;    // $A
+    };
+
+    // Home Assistant discovery templates, stored in flash. Each message consists of BASE_CONFIG
+    // followed by one of the entity specific parts.
+    extern const char BASE_CONFIG[] PROGMEM;
+    extern const char LIGHTBAR_CONFIG[] PROGMEM;
+    extern const char PAIR_CONFIG[] PROGMEM;
+    extern const char REMOTE_CONFIG[] PROGMEM;
+    extern const char ACTION_CONFIG[] PROGMEM;
+
+    // The controller's own diagnostics, see Metrics. Each message consists of DIAGNOSTICS_BASE_CONFIG
+    // followed by one of the sensors.
+    extern const char DIAGNOSTICS_BASE_CONFIG[] PROGMEM;
+    extern const char UPTIME_CONFIG[] PROGMEM;
+    extern const char FREE_HEAP_CONFIG[] PROGMEM;
+    extern const char MAX_FREE_BLOCK_CONFIG[] PROGMEM;
+    extern const char PACKAGES_ACCEPTED_CONFIG[] PROGMEM;
+    extern const char CHECKSUM_FAILURES_CONFIG[] PROGMEM;
+    extern const char FRAMES_SENT_CONFIG[] PROGMEM;
+    extern const char LOOP_TIME_CONFIG[] PROGMEM;
+    extern const char COMMAND_LATENCY_CONFIG[] PROGMEM;
+
+    extern const char LIGHTBAR_MODEL[] PROGMEM;
+    extern const char REMOTE_MODEL[] PROGMEM;
+    extern const char DIAGNOSTICS_MODEL[] PROGMEM;
+
+    // Returns the length of the rendered template without rendering it.
+    size_t measure(PGM_P part, const Values &values);
+
+    // Renders the template in small chunks directly into the given output and returns the number of bytes
+    // the output accepted.
+    size_t render(Print *output, PGM_P part, const Values &values);
+
+    // Returns the FNV-1a hash of the rendered template, continuing from the given hash.
+    uint32_t hash(PGM_P part, const Values &values, uint32_t hash);
+};
+
+#endif
@@ -0,0 +1,119 @@
+#include <EEPROM.h>
+
+#include "discovery_cache.h"
+#include "log.h"
+
+DiscoveryCache::DiscoveryCache()
+{
+    this->data.magic = DiscoveryCache::MAGIC;
+    this->data.count = 0;
+    this->startJob();
+}
+
+DiscoveryCache::~DiscoveryCache()
+{
+}
+
+void DiscoveryCache::load()
+{
+    // The emulated EEPROM keeps a RAM copy of the whole sector while it is open, so only open it briefly.
+    EEPROM.begin(sizeof(Data));
+    EEPROM.get(0, this->data);
+    EEPROM.end();
+
+    if (this->data.magic != DiscoveryCache::MAGIC || this->data.count > constants::DISCOVERY_CACHE_SIZE)
+    {
+        this->data.magic = DiscoveryCache::MAGIC;
+        this->data.count = 0;
+    }
+    this->dirty = false;
+    LOG(DISCOVERY_CACHE, INFO, "Loaded %u hashes.", this->data.count);
+}
+
+void DiscoveryCache::startJob()
+{
+    memset(this->seen, 0, sizeof(this->seen));
+}
+
+bool DiscoveryCache::isPublished(uint32_t topicHash, uint32_t payloadHash)
+{
+    int index = this->find(topicHash);
+    if (index < 0)
+        return false;
+    this->setSeen(index);
+    return this->data.entries[index].payloadHash == payloadHash;
+}
+
+void DiscoveryCache::setPublished(uint32_t topicHash, uint32_t payloadHash)
+{
+    int index = this->find(topicHash);
+    if (index >= 0)
+    {
+        this->setSeen(index);
+        if (this->data.entries[index].payloadHash != payloadHash)
+        {
+            this->data.entries[index].payloadHash = payloadHash;
+            this->dirty = true;
+        }
+        return;
+    }
+
+    // Without space left the message will simply be published again next time.
+    if (this->data.count >= constants::DISCOVERY_CACHE_SIZE)
+        return;
+    this->data.entries[this->data.count].topicHash = topicHash;
+    this->data.entries[this->data.count].payloadHash = payloadHash;
+    this->setSeen(this->data.count);
+    this->data.count++;
+    this->dirty = true;
+}
+
+void DiscoveryCache::finishJob()
+{
+    // The job came across every topic that is still in use, the others belong to serials or
+    // sensors that are gone.
+    uint8_t kept = 0;
+    for (uint8_t i = 0; i < this->data.count; i++)
+    {
+        if (this->isSeen(i))
+            this->data.entries[kept++] = this->data.entries[i];
+    }
+    if (kept == this->data.count)
+        return;
+    LOG(DISCOVERY_CACHE, INFO, "Dropped %u hashes of topics no longer in use.", this->data.count - kept);
+    this->data.count = kept;
+    this->dirty = true;
+}
+
+void DiscoveryCache::save()
+{
+    // Only write to flash if something actually changed.
+    if (!this->dirty)
+        return;
+    EEPROM.begin(sizeof(Data));
+    EEPROM.put(0, this->data);
+    if (!EEPROM.commit())
+        LOG(DISCOVERY_CACHE, ERROR, "Could not save hashes to flash!");
+    EEPROM.end();
+    this->dirty = false;
+}
+
+int DiscoveryCache::find(uint32_t topicHash)
+{
+    for (uint8_t i = 0; i < this->data.count; i++)
+    {
+        if (this->data.entries[i].topicHash == topicHash)
+            return i;
+    }
+    return -1;
+}
+
+void DiscoveryCache::setSeen(uint8_t index)
+{
+    this->seen[index / 8] |= 1 << (index % 8);
+}
+
+bool DiscoveryCache::isSeen(uint8_t index)
+{
+    return this->seen[index / 8] & (1 << (index % 8));
+}
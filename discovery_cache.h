@@ -0,0 +1,51 @@
+#ifndef DISCOVERY_CACHE_H
+#define DISCOVERY_CACHE_H
+
+#include <Arduino.h>
+
+#include "constants.h"
+
+// Remembers a hash of every Home Assistant discovery message that was published, keyed by a hash of
+// its topic. The hashes are persisted in flash, so retained configs that did not change are neither
+// published again after a reconnect nor after a reboot. Hashes of topics that a whole discovery job
+// did not come across, e.g. of a light bar that was removed from the config, are dropped again.
+class DiscoveryCache
+{
+public:
+    DiscoveryCache();
+    ~DiscoveryCache();
+    void load();
+    void startJob();
+    bool isPublished(uint32_t topicHash, uint32_t payloadHash);
+    void setPublished(uint32_t topicHash, uint32_t payloadHash);
+    void finishJob();
+    void save();
+
+private:
+    static const uint32_t MAGIC = 0x4C32446D;
+
+    struct Entry
+    {
+        uint32_t topicHash;
+        uint32_t payloadHash;
+    };
+
+    struct Data
+    {
+        uint32_t magic;
+        uint8_t count;
+        Entry entries[constants::DISCOVERY_CACHE_SIZE];
+    };
+
+    Data data;
+    bool dirty = false;
+
+    // One bit per entry, set when the current job came across its topic. Not persisted.
+    uint8_t seen[(constants::DISCOVERY_CACHE_SIZE + 7) / 8];
+
+    int find(uint32_t topicHash);
+    void setSeen(uint8_t index);
+    bool isSeen(uint8_t index);
+};
+
+#endif
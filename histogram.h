@@ -0,0 +1,36 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <Arduino.h>
+
+// Counts durations in microseconds into buckets of powers of two. Bucket 0 counts zero, bucket i
+// counts values from 2^(i-1) up to 2^i - 1, and the last bucket everything above. Adding a value
+// costs a count-leading-zeros and an increment, so this can be used on every loop.
+struct Histogram
+{
+    static const uint8_t BUCKETS = 24;
+
+    uint32_t buckets[BUCKETS] = {};
+    uint32_t count = 0;
+    uint32_t max = 0;
+
+    void add(uint32_t value)
+    {
+        uint8_t bucket = value == 0 ? 0 : 32 - __builtin_clz(value);
+        if (bucket >= BUCKETS)
+            bucket = BUCKETS - 1;
+        this->buckets[bucket]++;
+        this->count++;
+        if (value > this->max)
+            this->max = value;
+    }
+
+    void reset()
+    {
+        memset(this->buckets, 0, sizeof(this->buckets));
+        this->count = 0;
+        this->max = 0;
+    }
+};
+
+#endif
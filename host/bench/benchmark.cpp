@@ -0,0 +1,352 @@
+#include "controller.h"
+#include "frames.h"
+
+#include "checksum.h"
+#include "command.h"
+#include "discovery.h"
+
+#include <malloc.h>
+
+#include <chrono>
+#include <new>
+#include <string>
+#include <vector>
+
+// Measures the protocol and MQTT hot paths on the workstation. The numbers are no substitute for
+// measuring on the ESP8266, but tell whether a change made a routine faster or slower, and whether it
+// allocates. Usage: benchmark [--json] [--quick] [filter]
+
+// Every allocation is counted while a benchmark is being measured.
+static bool tracking = false;
+static uint64_t allocations = 0;
+static size_t heapInUse = 0;
+static size_t heapPeak = 0;
+
+void *operator new(size_t size)
+{
+    void *pointer = malloc(size);
+    if (pointer == nullptr)
+        throw std::bad_alloc();
+    if (tracking)
+    {
+        allocations++;
+        heapInUse += malloc_usable_size(pointer);
+        heapPeak = max(heapPeak, heapInUse);
+    }
+    return pointer;
+}
+
+void operator delete(void *pointer) noexcept
+{
+    if (tracking && pointer != nullptr)
+        heapInUse -= min(heapInUse, malloc_usable_size(pointer));
+    free(pointer);
+}
+
+void operator delete(void *pointer, size_t size) noexcept
+{
+    operator delete(pointer);
+}
+
+// Accumulates time and allocations of the measured parts of a benchmark run. A benchmark calls
+// resume() right before its hot loop and pause() right after, so setup is not measured.
+class Run
+{
+public:
+    uint64_t operations;
+    std::chrono::nanoseconds elapsed{0};
+    uint64_t allocations = 0;
+    size_t heapPeak = 0;
+
+    Run(uint64_t operations) : operations(operations) {}
+
+    void resume()
+    {
+        ::allocations = 0;
+        ::heapInUse = 0;
+        ::heapPeak = 0;
+        tracking = true;
+        this->start = std::chrono::steady_clock::now();
+    }
+
+    void pause()
+    {
+        this->elapsed += std::chrono::steady_clock::now() - this->start;
+        tracking = false;
+        this->allocations += ::allocations;
+        this->heapPeak = max(this->heapPeak, ::heapPeak);
+    }
+
+private:
+    std::chrono::steady_clock::time_point start;
+};
+
+struct Benchmark
+{
+    const char *name;
+    void (*function)(Run *run);
+};
+
+// Keeps the compiler from optimizing away results.
+static volatile uint32_t sink;
+
+static void crc16Table(Run *run)
+{
+    byte frame[17];
+    frames::build(frame, 0x123456, 1, 0x01, 0x00);
+    run->resume();
+    for (uint64_t i = 0; i < run->operations; i++)
+    {
+        frame[12] = i;
+        sink = checksum::crc16(frame, 15);
+    }
+    run->pause();
+}
+
+// The bit by bit algorithm the CRC library used before the table.
+static void crc16Bitwise(Run *run)
+{
+    byte frame[17];
+    frames::build(frame, 0x123456, 1, 0x01, 0x00);
+    run->resume();
+    for (uint64_t i = 0; i < run->operations; i++)
+    {
+        frame[12] = i;
+        sink = frames::crc16(frame, 15);
+    }
+    run->pause();
+}
+
+// Radio::loop() reading packages from the nRF24's FIFO and handling them. The FIFO holds three.
+static void receive(Run *run, uint32_t serial, bool noise, bool repeat)
+{
+    fake::resetAll();
+    Controller controller(0, 1);
+    byte raw[18];
+    srand(7);
+    for (uint64_t i = 0; i < run->operations; i += 3)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            if (noise)
+            {
+                for (size_t k = 0; k < sizeof(raw); k++)
+                    raw[k] = rand();
+            }
+            else
+                frames::raw(raw, serial, repeat ? 1 : i + j, 0x01, 0x00);
+            fake::nrf24.receive(raw, sizeof(raw));
+        }
+        run->resume();
+        controller.radio.loop();
+        run->pause();
+    }
+}
+
+static void receiveValid(Run *run)
+{
+    receive(run, Controller::FIRST_REMOTE, false, false);
+}
+
+static void receiveDuplicate(Run *run)
+{
+    receive(run, Controller::FIRST_REMOTE, false, true);
+}
+
+static void receiveUnknownSerial(Run *run)
+{
+    receive(run, 0x123456, false, false);
+}
+
+static void receiveNoise(Run *run)
+{
+    receive(run, 0, true, false);
+}
+
+// Assembling frames into the transmit queue. The queue is recreated whenever it is full.
+static void sendCommand(Run *run)
+{
+    fake::resetAll();
+    Registry registry;
+    FrameTemplate frame;
+    Radio::prepareFrameTemplate(&frame, 0x123456);
+    uint64_t done = 0;
+    while (done < run->operations)
+    {
+        Radio *radio = new Radio(&registry, 1, 2);
+        uint64_t batch = min((uint64_t)constants::MAX_QUEUED_FRAMES, run->operations - done);
+        run->resume();
+        for (uint64_t i = 0; i < batch; i++)
+            radio->sendCommand(&frame, Lightbar::Command::BRIGHTER, i);
+        run->pause();
+        done += batch;
+        delete radio;
+    }
+}
+
+// MQTT::onMessage() routing a command to the last of the given number of light bars and parsing it.
+static void onMessage(Run *run, uint8_t lightbars)
+{
+    fake::resetAll();
+    Controller controller(lightbars, 0);
+    std::string topic = controller.topic(Controller::FIRST_LIGHTBAR + lightbars - 1, "command").c_str();
+    std::string payload = "{\"state\":\"ON\",\"brightness\":128,\"color_temp\":250}";
+    std::vector<char> topicBuffer(topic.begin(), topic.end());
+    topicBuffer.push_back('\0');
+    std::vector<byte> payloadBuffer(payload.begin(), payload.end());
+    run->resume();
+    for (uint64_t i = 0; i < run->operations; i++)
+        controller.mqtt.onMessage(topicBuffer.data(), payloadBuffer.data(), payloadBuffer.size());
+    run->pause();
+}
+
+static void onMessage1(Run *run)
+{
+    onMessage(run, 1);
+}
+
+static void onMessage10(Run *run)
+{
+    onMessage(run, 10);
+}
+
+static void parseCommand(Run *run)
+{
+    std::string payload = "{\"state\":\"ON\",\"brightness\":128,\"color_temp\":250,\"transition\":0.5}";
+    std::vector<byte> buffer(payload.begin(), payload.end());
+    LightbarCommand command;
+    run->resume();
+    for (uint64_t i = 0; i < run->operations; i++)
+    {
+        parseLightbarCommand(buffer.data(), buffer.size(), &command);
+        sink = command.brightness;
+    }
+    run->pause();
+}
+
+class NullOutput : public Print
+{
+public:
+    size_t write(uint8_t c) override
+    {
+        return 1;
+    }
+
+    size_t write(const uint8_t *buffer, size_t size) override
+    {
+        sink = buffer[0];
+        return size;
+    }
+};
+
+// A light bar's discovery message: measuring it for the MQTT header, then rendering it.
+static void renderDiscovery(Run *run)
+{
+    discovery::Values values = {"l2m_0200C0FFEE", "lightbar2mqtt/l2m_0200C0FFEE", "0x100000", "Light bar", discovery::LIGHTBAR_MODEL, nullptr};
+    NullOutput output;
+    run->resume();
+    for (uint64_t i = 0; i < run->operations; i++)
+    {
+        sink = discovery::measure(discovery::BASE_CONFIG, values) + discovery::measure(discovery::LIGHTBAR_CONFIG, values);
+        discovery::render(&output, discovery::BASE_CONFIG, values);
+        discovery::render(&output, discovery::LIGHTBAR_CONFIG, values);
+    }
+    run->pause();
+}
+
+static void countCommand(void *context, Remote *remote, byte command, byte options)
+{
+    sink = command;
+}
+
+static void remoteCallback(Run *run, int listeners)
+{
+    fake::resetAll();
+    Controller controller(0, 1);
+    Remote *remote = controller.remotes[0];
+    for (int i = 0; i < listeners; i++)
+        remote->registerCommandListener(countCommand, nullptr);
+    run->resume();
+    for (uint64_t i = 0; i < run->operations; i++)
+        remote->callback(Lightbar::Command::ON_OFF, i);
+    run->pause();
+}
+
+static void remoteCallback1(Run *run)
+{
+    remoteCallback(run, 1);
+}
+
+static void remoteCallback10(Run *run)
+{
+    remoteCallback(run, constants::MAX_COMMAND_LISTENERS);
+}
+
+static const Benchmark BENCHMARKS[] = {
+    {"checksum.crc16.table", crc16Table},
+    {"checksum.crc16.bitwise", crc16Bitwise},
+    {"radio.receive.valid", receiveValid},
+    {"radio.receive.duplicate", receiveDuplicate},
+    {"radio.receive.unknown_serial", receiveUnknownSerial},
+    {"radio.receive.noise", receiveNoise},
+    {"radio.send_command", sendCommand},
+    {"mqtt.on_message.1_lightbar", onMessage1},
+    {"mqtt.on_message.10_lightbars", onMessage10},
+    {"command.parse", parseCommand},
+    {"discovery.render_lightbar", renderDiscovery},
+    {"remote.callback.1_listener", remoteCallback1},
+    {"remote.callback.10_listeners", remoteCallback10},
+};
+
+int main(int argc, char **argv)
+{
+    bool json = false;
+    bool quick = false;
+    const char *filter = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--json"))
+            json = true;
+        else if (!strcmp(argv[i], "--quick"))
+            quick = true;
+        else
+            filter = argv[i];
+    }
+
+    fake::quiet = true;
+    if (json)
+        printf("[\n");
+    else
+        printf("%-30s %12s %12s %12s\n", "benchmark", "ns/op", "allocs/op", "peak heap");
+
+    bool first = true;
+    for (const Benchmark &benchmark : BENCHMARKS)
+    {
+        if (filter != nullptr && strstr(benchmark.name, filter) == nullptr)
+            continue;
+
+        // Grow the number of operations until a run takes long enough to be measured reliably.
+        uint64_t operations = 300;
+        Run run(operations);
+        while (true)
+        {
+            run = Run(operations);
+            benchmark.function(&run);
+            if (quick || run.elapsed >= std::chrono::milliseconds(200) || operations >= 300000000)
+                break;
+            operations *= 4;
+        }
+
+        double nsPerOp = (double)run.elapsed.count() / run.operations;
+        double allocationsPerOp = (double)run.allocations / run.operations;
+        if (json)
+            printf("%s  {\"name\": \"%s\", \"ns_per_op\": %.2f, \"allocs_per_op\": %.3f, \"peak_heap_bytes\": %zu, \"operations\": %llu}",
+                   first ? "" : ",\n", benchmark.name, nsPerOp, allocationsPerOp, run.heapPeak, (unsigned long long)run.operations);
+        else
+            printf("%-30s %12.2f %12.3f %12zu\n", benchmark.name, nsPerOp, allocationsPerOp, run.heapPeak);
+        first = false;
+    }
+    if (json)
+        printf("\n]\n");
+    return 0;
+}
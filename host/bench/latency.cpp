@@ -0,0 +1,227 @@
+#include "controller.h"
+#include "frames.h"
+#include "test.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// Measures end-to-end latencies in simulated time, with the in-process broker on one side and the fake
+// nRF24 on the other: from a command on MQTT to the first and the last repeat of the frames it caused,
+// while a slider moves 10 light bars at once, and from a received package to the remote's action on
+// MQTT. Usage: latency [--json]
+//
+// Running the firmware takes no simulated time, so the results show how long commands wait for the
+// loop, the transmit queue and the radio. They are checked against bounds, which makes this a test.
+
+// How often the firmware's loop runs.
+static const uint64_t LOOP_INTERVAL_US = 1000;
+
+// Home Assistant sends a light group's members a new brightness every so often while the slider moves.
+// The slider goes up all the way, one of the light bar's brightness steps at a time, so every command
+// has to make it on air.
+static const uint8_t SLIDER_LIGHTBARS = 10;
+static const int SLIDER_STEPS = constants::LIGHTBAR_STEPS;
+static const uint64_t SLIDER_STEP_INTERVAL_US = 100000;
+
+static const int REMOTE_PRESSES = 200;
+
+// The frames a flush of one light bar's pending commands put into the transmit queue. The radio only
+// fetches commands once the queue ran empty, so they are all sent in one go, framed by the nRF24 going
+// from listening to transmitting and back.
+struct Batch
+{
+    uint32_t serial;
+    uint64_t firstAt;
+    uint64_t lastAt;
+};
+
+struct Latency
+{
+    const char *name;
+    std::vector<uint64_t> samples;
+
+    uint64_t percentile(int p) const
+    {
+        if (this->samples.empty())
+            return 0;
+        std::vector<uint64_t> sorted = this->samples;
+        std::sort(sorted.begin(), sorted.end());
+        size_t rank = (sorted.size() * p + 99) / 100;
+        return sorted[max(rank, (size_t)1) - 1];
+    }
+
+    uint64_t maximum() const
+    {
+        return this->samples.empty() ? 0 : *std::max_element(this->samples.begin(), this->samples.end());
+    }
+};
+
+static uint32_t serialOf(const fake::Payload &payload)
+{
+    return payload.data[8] << 16 | payload.data[9] << 8 | payload.data[10];
+}
+
+// Runs one loop and notes which frames went on air.
+static void step(Controller *controller, std::vector<Batch> *batches)
+{
+    bool wasListening = fake::nrf24.listening;
+    size_t written = fake::nrf24.tx.size();
+    controller->loop();
+    for (size_t i = written; i < fake::nrf24.tx.size(); i++)
+    {
+        const fake::Payload &payload = fake::nrf24.tx[i];
+        if (wasListening || batches->empty())
+            batches->push_back({serialOf(payload), payload.at, payload.at});
+        else
+            batches->back().lastAt = payload.at;
+        wasListening = false;
+    }
+    fake::advance(LOOP_INTERVAL_US);
+}
+
+static Latency firstRepeat = {"slider.command_to_first_repeat"};
+static Latency lastRepeat = {"slider.command_to_last_repeat"};
+static Latency action = {"remote.package_to_action"};
+static uint64_t sliderDuration = 0;
+
+static void measureSliderBurst()
+{
+    fake::resetAll();
+    Controller controller(SLIDER_LIGHTBARS, 0);
+    controller.settle();
+
+    struct Command
+    {
+        uint32_t serial;
+        uint64_t at;
+    };
+    std::vector<Command> commands;
+    std::vector<Batch> batches;
+
+    uint64_t start = fake::now_us;
+    for (int i = 0; i < SLIDER_STEPS; i++)
+    {
+        std::string payload = "{\"state\":\"ON\",\"brightness\":" + std::to_string(i + 1) + "}";
+        for (uint8_t j = 0; j < SLIDER_LIGHTBARS; j++)
+        {
+            uint32_t serial = Controller::FIRST_LIGHTBAR + j;
+            fake::broker.publish(controller.topic(serial, "command").c_str(), payload);
+            commands.push_back({serial, fake::now_us});
+        }
+        for (uint64_t t = 0; t < SLIDER_STEP_INTERVAL_US; t += LOOP_INTERVAL_US)
+            step(&controller, &batches);
+    }
+
+    // Let the radio send what is left.
+    auto busy = [&]
+    {
+        bool pending = false;
+        for (uint8_t j = 0; j < SLIDER_LIGHTBARS; j++)
+            pending = pending || controller.lightbars[j]->hasPendingCommands();
+        return pending || !fake::nrf24.listening;
+    };
+    for (int i = 0; i < 100000 && busy(); i++)
+        step(&controller, &batches);
+    CHECK(!busy());
+    sliderDuration = fake::now_us - start;
+
+    // A command is served by the light bar's first batch that started after it arrived. Later commands
+    // for the same light bar may be served by the same batch, as pending commands are combined.
+    int unserved = 0;
+    for (const Command &command : commands)
+    {
+        auto batch = std::find_if(batches.begin(), batches.end(), [&](const Batch &batch)
+                                  { return batch.serial == command.serial && batch.firstAt >= command.at; });
+        if (batch == batches.end())
+        {
+            unserved++;
+            continue;
+        }
+        firstRepeat.samples.push_back(batch->firstAt - command.at);
+        lastRepeat.samples.push_back(batch->lastAt - command.at);
+        CHECK(batch->lastAt - batch->firstAt >= (constants::FRAME_REPEATS - 1) * constants::FRAME_REPEAT_INTERVAL_US);
+
+        // Light bars are served in turns, so no other light bar gets to send twice while a command waits.
+        std::vector<uint32_t> servedBefore;
+        for (auto other = batches.begin(); other != batch; other++)
+        {
+            if (other->firstAt < command.at)
+                continue;
+            if (!CHECK(std::find(servedBefore.begin(), servedBefore.end(), other->serial) == servedBefore.end()))
+                break;
+            servedBefore.push_back(other->serial);
+        }
+    }
+    CHECK_EQUAL(0, unserved);
+}
+
+static void measureRemoteActions()
+{
+    fake::resetAll();
+    Controller controller(0, 1);
+    controller.settle();
+
+    std::string topic = controller.topic(Controller::FIRST_REMOTE, "state").c_str();
+    std::vector<Batch> batches;
+    srand(3);
+    for (int i = 0; i < REMOTE_PRESSES; i++)
+    {
+        // Packages arrive at any time between two loops.
+        uint64_t offset = rand() % LOOP_INTERVAL_US;
+        fake::advance(offset);
+        byte raw[18];
+        frames::raw(raw, Controller::FIRST_REMOTE, i + 1, Lightbar::Command::ON_OFF, 0x00);
+        CHECK(fake::nrf24.receive(raw, sizeof(raw)));
+        uint64_t receivedAt = fake::now_us;
+        fake::advance(LOOP_INTERVAL_US - offset);
+
+        size_t published = fake::broker.published.size();
+        for (int j = 0; j < 1000 && fake::broker.published.size() == published; j++)
+            step(&controller, &batches);
+        if (!CHECK(fake::broker.published.size() > published))
+            continue;
+        const fake::Message &message = fake::broker.published[published];
+        CHECK(message.topic == topic && message.payload == "press");
+        action.samples.push_back(message.at - receivedAt);
+
+        // Wait for the action to be cleared before the next press.
+        controller.settle(LOOP_INTERVAL_US, constants::ACTION_CLEAR_DELAY + 10);
+    }
+
+    // The package is read and its action published by the next loop.
+    CHECK(action.maximum() <= LOOP_INTERVAL_US);
+}
+
+int main(int argc, char **argv)
+{
+    bool json = argc > 1 && !strcmp(argv[1], "--json");
+    fake::quiet = true;
+
+    RUN(measureSliderBurst);
+    RUN(measureRemoteActions);
+
+    const Latency *latencies[] = {&firstRepeat, &lastRepeat, &action};
+    if (json)
+    {
+        printf("[\n");
+        for (size_t i = 0; i < sizeof(latencies) / sizeof(latencies[0]); i++)
+        {
+            const Latency *latency = latencies[i];
+            printf("  {\"name\": \"%s\", \"samples\": %zu, \"p50_us\": %llu, \"p99_us\": %llu, \"max_us\": %llu},\n",
+                   latency->name, latency->samples.size(), (unsigned long long)latency->percentile(50),
+                   (unsigned long long)latency->percentile(99), (unsigned long long)latency->maximum());
+        }
+        printf("  {\"name\": \"slider.duration\", \"duration_us\": %llu, \"commands\": %d}\n]\n",
+               (unsigned long long)sliderDuration, SLIDER_STEPS * SLIDER_LIGHTBARS);
+    }
+    else
+    {
+        printf("%-32s %8s %10s %10s %10s\n", "latency", "samples", "p50 ms", "p99 ms", "max ms");
+        for (const Latency *latency : latencies)
+            printf("%-32s %8zu %10.1f %10.1f %10.1f\n", latency->name, latency->samples.size(),
+                   latency->percentile(50) / 1000.0, latency->percentile(99) / 1000.0, latency->maximum() / 1000.0);
+        printf("%d slider commands to %d light bars sent in %.1f s\n", SLIDER_STEPS * SLIDER_LIGHTBARS, SLIDER_LIGHTBARS, sliderDuration / 1e6);
+    }
+    return test::report("latency");
+}
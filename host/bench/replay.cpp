@@ -0,0 +1,257 @@
+#include "frames.h"
+
+#include "radio.h"
+#include "registry.h"
+#include "remote.h"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Feeds packages recorded with RF_CAPTURE through the radio code again, e.g. to reproduce a problem
+// seen with real RF traffic or to compare the decoder's cost before and after a change.
+// Usage: replay [--speed <factor>] [--remote <serial>]... [--json] [capture file]
+//
+// The capture is read from the file or from stdin. Lines are "<micros> <36 hex digits>", as published
+// to <root topic>/capture or logged to the console, and "dropped <n>". By default the packages are
+// received as fast as the radio handles them. With --speed, they arrive at their recorded times, sped
+// up by the factor, and the three-slot FIFO of the nRF24 drops what loop() doesn't pick up in time.
+// Remotes are created for the given serials, or for every serial found in a valid frame.
+
+// How often the firmware's loop runs.
+static const uint64_t LOOP_INTERVAL_US = 1000;
+
+struct Package
+{
+    uint64_t at;
+    byte raw[18];
+};
+
+struct Capture
+{
+    std::vector<Package> packages;
+    uint32_t droppedWhileCapturing = 0;
+    uint32_t malformedLines = 0;
+
+    // The last timestamp as recorded, the packages' times are relative to the first one.
+    unsigned long lastTimestamp = 0;
+};
+
+static bool parseHex(const char *hex, byte *data, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        unsigned int value;
+        if (!isxdigit(hex[2 * i]) || !isxdigit(hex[2 * i + 1]) || sscanf(hex + 2 * i, "%2x", &value) != 1)
+            return false;
+        data[i] = value;
+    }
+    return hex[2 * length] == '\0' || isspace(hex[2 * length]);
+}
+
+static void read(FILE *file, Capture *capture)
+{
+    char line[256];
+    while (fgets(line, sizeof(line), file) != nullptr)
+    {
+        // Lines from the console carry the logger's prefix.
+        const char *start = strstr(line, "[Capture] ");
+        start = start != nullptr ? start + strlen("[Capture] ") : line;
+
+        unsigned long at;
+        unsigned int dropped;
+        char hex[64];
+        Package package;
+        if (sscanf(start, "dropped %u", &dropped) == 1)
+            capture->droppedWhileCapturing += dropped;
+        else if (sscanf(start, "%lu %63s", &at, hex) == 2 && strlen(hex) == 36 && parseHex(hex, package.raw, sizeof(package.raw)))
+        {
+            // Timestamps are micros() of the ESP8266, which wraps around after 71 minutes.
+            if (capture->packages.empty())
+                package.at = 0;
+            else
+                package.at = capture->packages.back().at + (uint32_t)(at - capture->lastTimestamp);
+            capture->lastTimestamp = at;
+            capture->packages.push_back(package);
+        }
+        else if (strspn(start, " \t\r\n") != strlen(start))
+            capture->malformedLines++;
+    }
+}
+
+// Decodes a package like a remote's frame, independently of the radio code, to find its serial.
+static bool serialOf(const Package &package, uint32_t *serial)
+{
+    byte frame[17];
+    memcpy(frame, frames::PREAMBLE, sizeof(frames::PREAMBLE));
+    for (size_t i = sizeof(frames::PREAMBLE); i < sizeof(frame); i++)
+        frame[i] = (uint16_t)(package.raw[i - 1] << 8 | package.raw[i]) >> 5;
+    byte shifted[18];
+    frames::shift(frame, shifted);
+    if (memcmp(shifted, package.raw, sizeof(frames::PREAMBLE) - 1) != 0 || frames::crc16(frame, 15) != (frame[15] << 8 | frame[16]))
+        return false;
+    *serial = frame[8] << 16 | frame[9] << 8 | frame[10];
+    return true;
+}
+
+static const char *const COMMAND_NAMES[] = {"unknown", "on_off", "cooler", "warmer", "brighter", "dimmer", "reset"};
+static const size_t COMMANDS = sizeof(COMMAND_NAMES) / sizeof(COMMAND_NAMES[0]);
+
+struct Events
+{
+    uint32_t count = 0;
+    uint32_t byCommand[COMMANDS] = {};
+};
+
+static void onCommand(void *context, Remote *remote, byte command, byte options)
+{
+    Events *events = (Events *)context;
+    events->count++;
+    events->byCommand[command < COMMANDS ? command : 0]++;
+}
+
+int main(int argc, char **argv)
+{
+    double speed = 0;
+    bool json = false;
+    std::vector<uint32_t> serials;
+    const char *path = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--speed") && i + 1 < argc)
+            speed = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--remote") && i + 1 < argc)
+            serials.push_back(strtoul(argv[++i], nullptr, 16));
+        else if (!strcmp(argv[i], "--json"))
+            json = true;
+        else if (argv[i][0] != '-' && path == nullptr)
+            path = argv[i];
+        else
+        {
+            fprintf(stderr, "usage: %s [--speed <factor>] [--remote <serial>]... [--json] [capture file]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    FILE *file = path != nullptr ? fopen(path, "r") : stdin;
+    if (file == nullptr)
+    {
+        perror(path);
+        return 1;
+    }
+    Capture capture;
+    read(file, &capture);
+    if (file != stdin)
+        fclose(file);
+
+    if (serials.empty())
+    {
+        for (const Package &package : capture.packages)
+        {
+            uint32_t serial;
+            if (serialOf(package, &serial) && std::find(serials.begin(), serials.end(), serial) == serials.end())
+                serials.push_back(serial);
+        }
+    }
+    if (serials.size() > constants::MAX_REMOTES)
+    {
+        fprintf(stderr, "Only the first %u of %zu serials get a remote.\n", constants::MAX_REMOTES, serials.size());
+        serials.resize(constants::MAX_REMOTES);
+    }
+
+    fake::quiet = true;
+    fake::nrf24.reset();
+    Registry registry;
+    Radio radio(&registry, 1, 2);
+    radio.setup();
+    Events events;
+    std::vector<Remote *> remotes;
+    for (uint32_t serial : serials)
+    {
+        Remote *remote = new Remote(&radio, serial, "Remote");
+        remote->registerCommandListener(onCommand, &events);
+        remotes.push_back(remote);
+    }
+
+    // Only the time spent in loops that had packages to handle is measured, not reading the capture,
+    // injecting packages or loops without anything to do.
+    std::chrono::nanoseconds elapsed{0};
+    auto loop = [&]
+    {
+        bool received = !fake::nrf24.rx.empty();
+        auto start = std::chrono::steady_clock::now();
+        radio.loop();
+        if (received)
+            elapsed += std::chrono::steady_clock::now() - start;
+    };
+
+    if (speed > 0 && !capture.packages.empty())
+    {
+        uint64_t start = fake::now_us;
+        uint64_t nextLoop = start;
+        for (const Package &package : capture.packages)
+        {
+            uint64_t at = start + (uint64_t)(package.at / speed);
+            for (; nextLoop <= at; nextLoop += LOOP_INTERVAL_US)
+            {
+                fake::advance(nextLoop - fake::now_us);
+                loop();
+            }
+            fake::advance(at - fake::now_us);
+            fake::nrf24.receive(package.raw, sizeof(package.raw));
+        }
+    }
+    else
+    {
+        for (const Package &package : capture.packages)
+        {
+            fake::nrf24.receive(package.raw, sizeof(package.raw));
+            loop();
+        }
+    }
+    for (int i = 0; i < 2; i++)
+        loop();
+
+    const RadioStats &stats = radio.getStats();
+    size_t packages = capture.packages.size();
+    double nsPerPackage = packages > 0 ? (double)elapsed.count() / packages : 0;
+    if (json)
+    {
+        printf("{\"packages\": %zu, \"remotes\": %zu, \"events\": %u, \"events_by_command\": {", packages, serials.size(), events.count);
+        for (size_t i = 0; i < COMMANDS; i++)
+            printf("%s\"%s\": %u", i > 0 ? ", " : "", COMMAND_NAMES[i], events.byCommand[i]);
+        printf("}, \"accepted\": %u, \"duplicates\": %u, \"preamble_rejects\": %u, \"checksum_failures\": %u, \"unknown_serials\": %u, ",
+               stats.packages_accepted, stats.duplicates, stats.preamble_rejects, stats.checksum_failures, stats.unknown_serials);
+        printf("\"dropped_while_capturing\": %u, \"dropped_by_fifo\": %u, \"dropped_by_buffer\": %u, \"malformed_lines\": %u, \"ns_per_package\": %.1f}\n",
+               capture.droppedWhileCapturing, fake::nrf24.rxDropped, stats.buffer_overflows, capture.malformedLines, nsPerPackage);
+    }
+    else
+    {
+        printf("packages              %zu\n", packages);
+        printf("remotes               %zu\n", serials.size());
+        printf("events                %u\n", events.count);
+        for (size_t i = 0; i < COMMANDS; i++)
+        {
+            if (events.byCommand[i] > 0)
+                printf("  %-19s %u\n", COMMAND_NAMES[i], events.byCommand[i]);
+        }
+        printf("accepted              %u\n", stats.packages_accepted);
+        printf("duplicates            %u\n", stats.duplicates);
+        printf("preamble rejects      %u\n", stats.preamble_rejects);
+        printf("checksum failures     %u\n", stats.checksum_failures);
+        printf("unknown serials       %u\n", stats.unknown_serials);
+        printf("dropped by capture    %u\n", capture.droppedWhileCapturing);
+        printf("dropped by FIFO       %u\n", fake::nrf24.rxDropped);
+        printf("dropped by buffer     %u\n", stats.buffer_overflows);
+        printf("malformed lines       %u\n", capture.malformedLines);
+        printf("time per package      %.1f ns\n", nsPerPackage);
+    }
+
+    for (Remote *remote : remotes)
+    {
+        radio.removeRemote(remote);
+        delete remote;
+    }
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include <Arduino.h>
+
+HardwareSerial Serial;
+EspClass ESP;
+
+uint64_t fake::now_us = 0;
+bool fake::quiet = false;
+
+static struct
+{
+    void (*handler)(void *);
+    void *arg;
+} interrupts[16];
+
+void fake::advance(uint64_t us)
+{
+    fake::now_us += us;
+}
+
+void fake::interrupt(uint8_t pin)
+{
+    if (pin < 16 && interrupts[pin].handler != nullptr)
+        interrupts[pin].handler(interrupts[pin].arg);
+}
+
+String::String(unsigned long value, unsigned char base)
+{
+    char buffer[24];
+    snprintf(buffer, sizeof(buffer), base == HEX ? "%lx" : "%lu", value);
+    this->value = buffer;
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+    if (!fake::quiet)
+        fwrite(buffer, 1, size, stdout);
+    return size;
+}
+
+void EspClass::restart()
+{
+    fprintf(stderr, "ESP.restart() called\n");
+    abort();
+}
+
+uint32_t EspClass::getFreeHeap()
+{
+    return 40000;
+}
+
+uint32_t EspClass::getMaxFreeBlockSize()
+{
+    return 30000;
+}
+
+unsigned long millis()
+{
+    return fake::now_us / 1000;
+}
+
+unsigned long micros()
+{
+    return fake::now_us;
+}
+
+void delay(unsigned long ms)
+{
+    fake::advance(ms * 1000ull);
+}
+
+void yield()
+{
+}
+
+long random(long max)
+{
+    return max > 0 ? rand() % max : 0;
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+}
+
+void attachInterruptArg(uint8_t pin, void (*handler)(void *), void *arg, int mode)
+{
+    if (pin < 16)
+        interrupts[pin] = {handler, arg};
+}
+
+void detachInterrupt(uint8_t pin)
+{
+    if (pin < 16)
+        interrupts[pin] = {nullptr, nullptr};
+}
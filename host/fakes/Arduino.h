@@ -0,0 +1,132 @@
+#ifndef FAKE_ARDUINO_H
+#define FAKE_ARDUINO_H
+
+// Just enough of the ESP8266 Arduino core to compile the sketch's .cpp files on a workstation. Flash
+// and IRAM placement are no-ops here, and time only moves when a test advances it, see fake::now_us.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include <algorithm>
+#include <functional>
+#include <string>
+
+typedef uint8_t byte;
+typedef unsigned int uint;
+
+#define HEX 16
+#define DEC 10
+
+#define INPUT 0x00
+#define INPUT_PULLUP 0x02
+#define FALLING 0x02
+
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+#define IRAM_ATTR
+#define pgm_read_byte(address) (*(const uint8_t *)(address))
+#define pgm_read_word(address) (*(const uint16_t *)(address))
+#define strlen_P strlen
+#define vsnprintf_P vsnprintf
+#define digitalPinToInterrupt(pin) (pin)
+
+using std::max;
+using std::min;
+
+class String
+{
+public:
+    String() {}
+    String(const char *value) : value(value != nullptr ? value : "") {}
+    String(const std::string &value) : value(value) {}
+    String(unsigned long value, unsigned char base = DEC);
+
+    const char *c_str() const { return this->value.c_str(); }
+    unsigned int length() const { return this->value.length(); }
+
+    String &operator+=(const String &other)
+    {
+        this->value += other.value;
+        return *this;
+    }
+    bool operator==(const String &other) const { return this->value == other.value; }
+    bool operator!=(const String &other) const { return this->value != other.value; }
+
+    friend String operator+(const String &a, const String &b) { return String(a.value + b.value); }
+    friend String operator+(const String &a, const char *b) { return String(a.value + b); }
+    friend String operator+(const char *a, const String &b) { return String(a + b.value); }
+
+private:
+    std::string value;
+};
+
+class Print
+{
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size)
+    {
+        size_t written = 0;
+        while (size-- > 0 && this->write(*buffer++) == 1)
+            written++;
+        return written;
+    }
+    size_t write(const char *buffer, size_t size) { return this->write((const uint8_t *)buffer, size); }
+};
+
+// Writes to stdout, unless fake::quiet is set.
+class HardwareSerial : public Print
+{
+public:
+    void begin(unsigned long baud) {}
+    int availableForWrite() { return 1024; }
+    void flush() { fflush(stdout); }
+    size_t write(uint8_t c) override { return this->write(&c, 1); }
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+};
+
+extern HardwareSerial Serial;
+
+class EspClass
+{
+public:
+    // Aborts, as nothing can continue after it.
+    void restart();
+    uint32_t getFreeHeap();
+    uint32_t getMaxFreeBlockSize();
+};
+
+extern EspClass ESP;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+long random(long max);
+void pinMode(uint8_t pin, uint8_t mode);
+void attachInterruptArg(uint8_t pin, void (*handler)(void *), void *arg, int mode);
+void detachInterrupt(uint8_t pin);
+
+namespace fake
+{
+    // The simulated time in microseconds that millis() and micros() are based on. Only delay() and
+    // advance() move it. Unlike on the ESP8266, it does not wrap around after 71 minutes.
+    extern uint64_t now_us;
+
+    // Suppresses everything written to Serial, e.g. for benchmarks.
+    extern bool quiet;
+
+    void advance(uint64_t us);
+
+    // Calls the handler attached to the given pin, if there is one.
+    void interrupt(uint8_t pin);
+}
+
+#endif
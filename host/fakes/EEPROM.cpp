@@ -0,0 +1,11 @@
+#include <EEPROM.h>
+
+EEPROMClass EEPROM;
+
+uint32_t fake::eepromCommits = 0;
+
+bool EEPROMClass::commit()
+{
+    fake::eepromCommits++;
+    return true;
+}
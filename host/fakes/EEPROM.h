@@ -0,0 +1,42 @@
+#ifndef FAKE_EEPROM_H
+#define FAKE_EEPROM_H
+
+#include <Arduino.h>
+
+// Keeps its contents in RAM for the lifetime of the process, so they survive a simulated restart.
+class EEPROMClass
+{
+public:
+    // Starts out like erased flash.
+    EEPROMClass() { memset(this->data, 0xFF, sizeof(this->data)); }
+
+    void begin(size_t size) {}
+    bool commit();
+    void end() {}
+
+    template <typename T>
+    T &get(int address, T &value)
+    {
+        memcpy(&value, this->data + address, sizeof(T));
+        return value;
+    }
+
+    template <typename T>
+    const T &put(int address, const T &value)
+    {
+        memcpy(this->data + address, &value, sizeof(T));
+        return value;
+    }
+
+private:
+    uint8_t data[4096];
+};
+
+extern EEPROMClass EEPROM;
+
+namespace fake
+{
+    extern uint32_t eepromCommits;
+}
+
+#endif
@@ -0,0 +1,29 @@
+#include <ESP8266WiFi.h>
+
+ESP8266WiFiClass WiFi;
+
+wl_status_t fake::wifiStatus = WL_CONNECTED;
+uint32_t fake::wifiBegins = 0;
+
+wl_status_t ESP8266WiFiClass::begin(const char *ssid, const char *password)
+{
+    fake::wifiBegins++;
+    return fake::wifiStatus;
+}
+
+wl_status_t ESP8266WiFiClass::status()
+{
+    return fake::wifiStatus;
+}
+
+bool ESP8266WiFiClass::isConnected()
+{
+    return fake::wifiStatus == WL_CONNECTED;
+}
+
+uint8_t *ESP8266WiFiClass::macAddress(uint8_t *mac)
+{
+    static const uint8_t address[6] = {0x02, 0x00, 0x00, 0xC0, 0xFF, 0xEE};
+    memcpy(mac, address, sizeof(address));
+    return mac;
+}
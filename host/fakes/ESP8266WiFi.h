@@ -0,0 +1,63 @@
+#ifndef FAKE_ESP8266WIFI_H
+#define FAKE_ESP8266WIFI_H
+
+#include <Arduino.h>
+
+typedef enum
+{
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_WRONG_PASSWORD = 6,
+    WL_DISCONNECTED = 7
+} wl_status_t;
+
+typedef enum
+{
+    WIFI_OFF = 0,
+    WIFI_STA = 1
+} WiFiMode_t;
+
+class IPAddress
+{
+public:
+    String toString() const { return "192.0.2.1"; }
+};
+
+class Client
+{
+public:
+    void setTimeout(unsigned long timeout) {}
+};
+
+class WiFiClient : public Client
+{
+};
+
+// Reports whatever status a test sets in fake::wifiStatus.
+class ESP8266WiFiClass
+{
+public:
+    bool persistent(bool persistent) { return true; }
+    bool mode(WiFiMode_t mode) { return true; }
+    bool setAutoReconnect(bool autoReconnect) { return true; }
+    bool setHostname(const char *hostname) { return true; }
+    wl_status_t begin(const char *ssid, const char *password);
+    bool disconnect(bool wifiOff = false) { return true; }
+    wl_status_t status();
+    bool isConnected();
+    IPAddress localIP() { return IPAddress(); }
+    uint8_t *macAddress(uint8_t *mac);
+    int8_t RSSI() { return -60; }
+};
+
+extern ESP8266WiFiClass WiFi;
+
+namespace fake
+{
+    extern wl_status_t wifiStatus;
+    extern uint32_t wifiBegins;
+}
+
+#endif
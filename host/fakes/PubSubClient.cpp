@@ -0,0 +1,224 @@
+#include <PubSubClient.h>
+
+fake::Broker fake::broker;
+
+PubSubClient::~PubSubClient()
+{
+    fake::broker.detach(this);
+}
+
+PubSubClient &PubSubClient::setCallback(MQTT_CALLBACK_SIGNATURE)
+{
+    this->callback = callback;
+    return *this;
+}
+
+bool PubSubClient::connect(const char *id, const char *user, const char *pass, const char *willTopic, uint8_t willQos, bool willRetain, const char *willMessage)
+{
+    if (!fake::broker.online)
+    {
+        this->connectionState = MQTT_CONNECT_FAILED;
+        return false;
+    }
+    this->connectionState = MQTT_CONNECTED;
+    this->subscriptions.clear();
+    this->inbox.clear();
+    this->willTopic = willTopic != nullptr ? willTopic : "";
+    this->willMessage = willMessage != nullptr ? willMessage : "";
+    this->willRetain = willRetain;
+    fake::broker.attach(this);
+    return true;
+}
+
+void PubSubClient::disconnect()
+{
+    this->connectionState = MQTT_DISCONNECTED;
+    fake::broker.detach(this);
+}
+
+void PubSubClient::drop()
+{
+    this->connectionState = MQTT_CONNECTION_LOST;
+    fake::broker.detach(this);
+    if (!this->willTopic.empty())
+        fake::broker.receive(this->willTopic, this->willMessage, this->willRetain);
+}
+
+bool PubSubClient::connected()
+{
+    return this->connectionState == MQTT_CONNECTED;
+}
+
+int PubSubClient::state()
+{
+    return this->connectionState;
+}
+
+bool PubSubClient::publish(const char *topic, const char *payload, bool retained)
+{
+    return this->publish(topic, (const uint8_t *)payload, payload != nullptr ? strlen(payload) : 0, retained);
+}
+
+bool PubSubClient::publish(const char *topic, const uint8_t *payload, unsigned int length, bool retained)
+{
+    // The whole packet has to fit into the client's buffer.
+    if (!this->connected() || MQTT_MAX_PACKET_SIZE < MQTT_MAX_HEADER_SIZE + 2 + strlen(topic) + length)
+        return false;
+    if (fake::broker.failWrites)
+    {
+        this->drop();
+        return false;
+    }
+    fake::broker.receive(topic, std::string((const char *)payload, length), retained);
+    return true;
+}
+
+bool PubSubClient::beginPublish(const char *topic, unsigned int length, bool retained)
+{
+    if (!this->connected())
+        return false;
+    this->streamTopic = topic;
+    this->streamPayload.clear();
+    this->streamLength = length;
+    this->streamRetained = retained;
+    return true;
+}
+
+size_t PubSubClient::write(uint8_t c)
+{
+    return this->write(&c, 1);
+}
+
+size_t PubSubClient::write(const uint8_t *buffer, size_t size)
+{
+    if (!this->connected() || fake::broker.failWrites)
+        return 0;
+    this->streamPayload.append((const char *)buffer, size);
+    return size;
+}
+
+int PubSubClient::endPublish()
+{
+    // The broker cannot parse a packet whose payload does not match its announced length and closes
+    // the connection. The client only notices later.
+    if (this->streamPayload.size() != this->streamLength)
+    {
+        this->drop();
+        return 1;
+    }
+    fake::broker.receive(this->streamTopic, this->streamPayload, this->streamRetained);
+    return 1;
+}
+
+bool PubSubClient::subscribe(const char *topic)
+{
+    if (!this->connected())
+        return false;
+    this->subscriptions.push_back(topic);
+    return true;
+}
+
+bool PubSubClient::loop()
+{
+    if (!this->connected())
+        return false;
+
+    // The callback may publish or subscribe, so deliver from a copy.
+    std::vector<std::pair<std::string, std::string>> messages;
+    messages.swap(this->inbox);
+    for (auto &message : messages)
+    {
+        if (!this->callback)
+            continue;
+        std::vector<char> topic(message.first.begin(), message.first.end());
+        topic.push_back('\0');
+        this->callback(topic.data(), (uint8_t *)&message.second[0], message.second.size());
+    }
+    return this->connected();
+}
+
+void PubSubClient::route(const std::string &topic, const std::string &payload)
+{
+    for (auto &subscription : this->subscriptions)
+    {
+        if (fake::Broker::matches(subscription, topic))
+        {
+            this->inbox.push_back({topic, payload});
+            return;
+        }
+    }
+}
+
+void fake::Broker::publish(const std::string &topic, const std::string &payload)
+{
+    for (PubSubClient *client : this->clients)
+        client->route(topic, payload);
+}
+
+void fake::Broker::disconnectAll()
+{
+    std::vector<PubSubClient *> dropped;
+    dropped.swap(this->clients);
+    for (PubSubClient *client : dropped)
+        client->drop();
+}
+
+const fake::Message *fake::Broker::last(const std::string &topic) const
+{
+    for (auto message = this->published.rbegin(); message != this->published.rend(); message++)
+    {
+        if (message->topic == topic)
+            return &*message;
+    }
+    return nullptr;
+}
+
+void fake::Broker::reset()
+{
+    this->disconnectAll();
+    this->online = true;
+    this->failWrites = false;
+    this->published.clear();
+    this->connects = 0;
+}
+
+bool fake::Broker::matches(const std::string &filter, const std::string &topic)
+{
+    size_t f = 0;
+    size_t t = 0;
+    while (f < filter.size())
+    {
+        if (filter[f] == '#')
+            return true;
+        if (filter[f] == '+')
+        {
+            while (t < topic.size() && topic[t] != '/')
+                t++;
+            f++;
+            continue;
+        }
+        if (t >= topic.size() || filter[f] != topic[t])
+            return false;
+        f++;
+        t++;
+    }
+    return t == topic.size();
+}
+
+void fake::Broker::attach(PubSubClient *client)
+{
+    this->detach(client);
+    this->clients.push_back(client);
+    this->connects++;
+}
+
+void fake::Broker::detach(PubSubClient *client)
+{
+    this->clients.erase(std::remove(this->clients.begin(), this->clients.end(), client), this->clients.end());
+}
+
+void fake::Broker::receive(const std::string &topic, const std::string &payload, bool retained)
+{
+    this->published.push_back({topic, payload, retained, fake::now_us});
+    this->publish(topic, payload);
+}
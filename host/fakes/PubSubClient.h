@@ -0,0 +1,122 @@
+#ifndef FAKE_PUBSUBCLIENT_H
+#define FAKE_PUBSUBCLIENT_H
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+
+#include <string>
+#include <vector>
+
+#define MQTT_MAX_HEADER_SIZE 5
+#define MQTT_MAX_PACKET_SIZE 256
+#define MQTT_CONNECTION_LOST -3
+#define MQTT_CONNECT_FAILED -2
+#define MQTT_DISCONNECTED -1
+#define MQTT_CONNECTED 0
+
+#define MQTT_CALLBACK_SIGNATURE std::function<void(char *, uint8_t *, unsigned int)> callback
+
+// Talks to the in-process broker fake::broker instead of a socket. Limits and return values follow
+// PubSubClient 2.8, e.g. endPublish() always returns 1.
+class PubSubClient : public Print
+{
+public:
+    PubSubClient(Client &client) {}
+    ~PubSubClient();
+
+    PubSubClient &setServer(const char *domain, uint16_t port) { return *this; }
+    PubSubClient &setCallback(MQTT_CALLBACK_SIGNATURE);
+    PubSubClient &setSocketTimeout(uint16_t timeout) { return *this; }
+
+    bool connect(const char *id, const char *user, const char *pass, const char *willTopic, uint8_t willQos, bool willRetain, const char *willMessage);
+    void disconnect();
+    bool connected();
+    int state();
+
+    bool publish(const char *topic, const char *payload, bool retained);
+    bool publish(const char *topic, const uint8_t *payload, unsigned int length, bool retained);
+    bool beginPublish(const char *topic, unsigned int length, bool retained);
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    int endPublish();
+
+    bool subscribe(const char *topic);
+
+    // Delivers the messages the broker routed to this client since the last call.
+    bool loop();
+
+    // Used by the broker.
+    void route(const std::string &topic, const std::string &payload);
+
+    // Loses the connection without the client asking for it, so the broker publishes the last will.
+    void drop();
+
+private:
+    std::function<void(char *, uint8_t *, unsigned int)> callback;
+    int connectionState = MQTT_DISCONNECTED;
+    std::vector<std::string> subscriptions;
+    std::vector<std::pair<std::string, std::string>> inbox;
+    std::string willTopic;
+    std::string willMessage;
+    bool willRetain = false;
+
+    // The message being streamed between beginPublish() and endPublish().
+    std::string streamTopic;
+    std::string streamPayload;
+    unsigned int streamLength = 0;
+    bool streamRetained = false;
+};
+
+namespace fake
+{
+    struct Message
+    {
+        std::string topic;
+        std::string payload;
+        bool retained;
+
+        // micros() when the broker received the message.
+        uint64_t at;
+    };
+
+    class Broker
+    {
+    public:
+        // Whether clients can connect.
+        bool online = true;
+
+        // Lets the connection accept no more payload bytes, as if the socket was stuck.
+        bool failWrites = false;
+
+        // Everything the clients published, in order.
+        std::vector<Message> published;
+
+        // How often clients connected.
+        uint32_t connects = 0;
+
+        // Routes a message to all clients subscribed to its topic, as if another client published it.
+        void publish(const std::string &topic, const std::string &payload);
+
+        // Drops all connections, as if the network failed. The clients' last wills are published.
+        void disconnectAll();
+
+        // Returns the last published message with the given topic, or nullptr.
+        const Message *last(const std::string &topic) const;
+
+        void reset();
+
+        static bool matches(const std::string &filter, const std::string &topic);
+
+        // Used by the clients.
+        void attach(PubSubClient *client);
+        void detach(PubSubClient *client);
+        void receive(const std::string &topic, const std::string &payload, bool retained);
+
+    private:
+        std::vector<PubSubClient *> clients;
+    };
+
+    extern Broker broker;
+}
+
+#endif
@@ -0,0 +1,66 @@
+#include <RF24.h>
+
+fake::NRF24 fake::nrf24;
+
+bool fake::NRF24::receive(const uint8_t *data, uint8_t length)
+{
+    if (!this->listening || this->rx.size() >= 3)
+    {
+        this->rxDropped++;
+        return false;
+    }
+    Payload payload = {};
+    memcpy(payload.data, data, min(length, (uint8_t)sizeof(payload.data)));
+    payload.length = this->payloadSize;
+    payload.at = fake::now_us;
+    this->rx.push_back(payload);
+    return true;
+}
+
+void fake::NRF24::reset()
+{
+    *this = NRF24();
+}
+
+bool RF24::begin()
+{
+    return fake::nrf24.responding;
+}
+
+void RF24::setPayloadSize(uint8_t size)
+{
+    fake::nrf24.payloadSize = size;
+}
+
+void RF24::startListening()
+{
+    fake::nrf24.listening = true;
+}
+
+void RF24::stopListening()
+{
+    fake::nrf24.listening = false;
+}
+
+bool RF24::available()
+{
+    return !fake::nrf24.rx.empty();
+}
+
+void RF24::read(void *buffer, uint8_t length)
+{
+    if (fake::nrf24.rx.empty())
+        return;
+    memcpy(buffer, fake::nrf24.rx.front().data, min(length, (uint8_t)sizeof(fake::Payload::data)));
+    fake::nrf24.rx.pop_front();
+}
+
+bool RF24::write(const void *buffer, uint8_t length, bool multicast)
+{
+    fake::Payload payload = {};
+    memcpy(payload.data, buffer, min(length, (uint8_t)sizeof(payload.data)));
+    payload.length = length;
+    payload.at = fake::now_us;
+    fake::nrf24.tx.push_back(payload);
+    return true;
+}
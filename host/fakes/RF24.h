@@ -0,0 +1,71 @@
+#ifndef FAKE_RF24_H
+#define FAKE_RF24_H
+
+#include <Arduino.h>
+
+#include <deque>
+#include <vector>
+
+#define RF24_2MBPS 1
+
+// The nRF24 as seen over SPI. All instances share the single simulated chip, fake::nrf24.
+class RF24
+{
+public:
+    bool failureDetected = false;
+
+    RF24() {}
+    RF24(uint8_t ce, uint8_t csn) {}
+
+    bool begin();
+    void openReadingPipe(uint8_t number, uint64_t address) {}
+    void openWritingPipe(uint64_t address) {}
+    void setChannel(uint8_t channel) {}
+    bool setDataRate(int speed) { return true; }
+    void disableCRC() {}
+    void disableDynamicPayloads() {}
+    void setPayloadSize(uint8_t size);
+    void setAutoAck(bool enable) {}
+    void setRetries(uint8_t delay, uint8_t count) {}
+    void maskIRQ(bool tx_ok, bool tx_fail, bool rx_ready) {}
+    void startListening();
+    void stopListening();
+    void powerDown() {}
+    bool available();
+    void read(void *buffer, uint8_t length);
+    bool write(const void *buffer, uint8_t length, bool multicast);
+};
+
+namespace fake
+{
+    struct Payload
+    {
+        uint8_t data[32];
+        uint8_t length;
+
+        // micros() when the payload was received or written.
+        uint64_t at;
+    };
+
+    struct NRF24
+    {
+        bool responding = true;
+        bool listening = false;
+        uint8_t payloadSize = 32;
+
+        // Received payloads not read yet. Like the chip's FIFO, it holds three and drops the rest.
+        std::deque<Payload> rx;
+        uint32_t rxDropped = 0;
+
+        // Everything written, in order.
+        std::vector<Payload> tx;
+
+        // Puts a received payload into the FIFO. It is only received while listening.
+        bool receive(const uint8_t *data, uint8_t length);
+        void reset();
+    };
+
+    extern NRF24 nrf24;
+}
+
+#endif
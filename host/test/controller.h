@@ -0,0 +1,108 @@
+#ifndef CONTROLLER_H
+#define CONTROLLER_H
+
+#include <EEPROM.h>
+#include <PubSubClient.h>
+#include <RF24.h>
+
+#include "lightbar.h"
+#include "log.h"
+#include "mqtt.h"
+#include "radio.h"
+#include "registry.h"
+#include "remote.h"
+#include "scheduler.h"
+
+// The objects Lightbar.ino sets up, wired the same way, with the given number of light bars and
+// remotes. Light bars use the serials 0x100000, 0x100001, ..., remotes 0x200000, 0x200001, ...
+struct Controller
+{
+    static const uint32_t FIRST_LIGHTBAR = 0x100000;
+    static const uint32_t FIRST_REMOTE = 0x200000;
+
+    WiFiClient wifiClient;
+    Registry registry;
+    Scheduler scheduler;
+    Radio radio;
+    MQTT mqtt;
+    Lightbar *lightbars[constants::MAX_LIGHTBARS] = {};
+    Remote *remotes[constants::MAX_REMOTES] = {};
+    uint8_t lightbarCount;
+    uint8_t remoteCount;
+
+    Controller(uint8_t lightbarCount, uint8_t remoteCount, bool homeAssistantDiscovery = true)
+        : radio(&registry, 1, 2),
+          mqtt(&registry, &scheduler, &wifiClient, "broker", 1883, "", "", "lightbar2mqtt", homeAssistantDiscovery, "homeassistant")
+    {
+        this->lightbarCount = lightbarCount;
+        this->remoteCount = remoteCount;
+        this->radio.setup();
+        for (uint8_t i = 0; i < remoteCount; i++)
+        {
+            this->remotes[i] = new Remote(&this->radio, FIRST_REMOTE + i, "Remote");
+            this->mqtt.addRemote(this->remotes[i]);
+        }
+        for (uint8_t i = 0; i < lightbarCount; i++)
+        {
+            this->lightbars[i] = new Lightbar(&this->radio, FIRST_LIGHTBAR + i, "Light bar");
+            this->mqtt.addLightbar(this->lightbars[i]);
+        }
+        this->mqtt.setup();
+    }
+
+    ~Controller()
+    {
+        for (uint8_t i = 0; i < this->remoteCount; i++)
+        {
+            this->mqtt.removeRemote(this->remotes[i]);
+            this->radio.removeRemote(this->remotes[i]);
+            delete this->remotes[i];
+        }
+        for (uint8_t i = 0; i < this->lightbarCount; i++)
+        {
+            this->mqtt.removeLightbar(this->lightbars[i]);
+            this->radio.removeLightbar(this->lightbars[i]);
+            delete this->lightbars[i];
+        }
+    }
+
+    void loop()
+    {
+        this->mqtt.loop();
+        this->radio.loop();
+        this->scheduler.loop();
+        logger::loop();
+    }
+
+    // Runs the loop until it has nothing left to do, advancing the time by the given step each time.
+    void settle(unsigned long stepUs = 1000, int loops = 1000)
+    {
+        for (int i = 0; i < loops; i++)
+        {
+            this->loop();
+            fake::advance(stepUs);
+        }
+    }
+
+    String topic(uint32_t serial, const char *action)
+    {
+        char buffer[16];
+        snprintf(buffer, sizeof(buffer), "/0x%x/", serial);
+        return this->mqtt.getCombinedRootTopic() + buffer + action;
+    }
+};
+
+namespace fake
+{
+    // Starts with a blank network, broker, radio and flash.
+    inline void resetAll()
+    {
+        fake::broker.reset();
+        fake::nrf24.reset();
+        fake::wifiStatus = WL_CONNECTED;
+        uint32_t erased = 0xFFFFFFFF;
+        EEPROM.put(0, erased);
+    }
+}
+
+#endif
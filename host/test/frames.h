@@ -0,0 +1,58 @@
+#ifndef FRAMES_H
+#define FRAMES_H
+
+#include <Arduino.h>
+
+// Builds packages like a remote sends them, independently of the code under test.
+
+namespace frames
+{
+    static const byte PREAMBLE[8] = {0x53, 0x39, 0x14, 0xDD, 0x1C, 0x49, 0x34, 0x12};
+
+    // CRC-16 with polynomial 0x1021 and initial value 0xFFFE, bit by bit.
+    inline uint16_t crc16(const byte *data, size_t length)
+    {
+        uint16_t crc = 0xFFFE;
+        for (size_t i = 0; i < length; i++)
+        {
+            crc ^= data[i] << 8;
+            for (int bit = 0; bit < 8; bit++)
+                crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+        return crc;
+    }
+
+    // The 17 bytes of a frame, see radio.cpp.
+    inline void build(byte *frame, uint32_t serial, uint8_t sequence, byte command, byte options)
+    {
+        memcpy(frame, PREAMBLE, sizeof(PREAMBLE));
+        frame[8] = serial >> 16;
+        frame[9] = serial >> 8;
+        frame[10] = serial;
+        frame[11] = 0xFF;
+        frame[12] = sequence;
+        frame[13] = command;
+        frame[14] = options;
+        uint16_t crc = crc16(frame, 15);
+        frame[15] = crc >> 8;
+        frame[16] = crc;
+    }
+
+    // The frame as the nRF24 receives it: shifted left by three bits, as the leading 5 is lost.
+    inline void shift(const byte *frame, byte *raw)
+    {
+        for (int i = 0; i < 17; i++)
+            raw[i] = frame[i] << 5 | (i < 16 ? frame[i + 1] >> 3 : 0);
+        raw[17] = 0;
+    }
+
+    // The raw package a remote sends for the given button event.
+    inline void raw(byte *raw, uint32_t serial, uint8_t sequence, byte command, byte options)
+    {
+        byte frame[17];
+        build(frame, serial, sequence, command, options);
+        shift(frame, raw);
+    }
+}
+
+#endif
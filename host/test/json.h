@@ -0,0 +1,125 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <ctype.h>
+#include <string.h>
+
+#include <string>
+
+// A strict JSON syntax check, enough to tell whether Home Assistant can parse a payload. Values nested
+// deeper than maxDepth are rejected, the top level value is at depth 0.
+class JsonChecker
+{
+public:
+    JsonChecker(const std::string &text, int maxDepth = 16) : text(text), maxDepth(maxDepth) {}
+
+    bool valid()
+    {
+        return this->value(0) && this->skipSpace() == this->text.size();
+    }
+
+private:
+    const std::string &text;
+    int maxDepth;
+    size_t position = 0;
+
+    size_t skipSpace()
+    {
+        while (this->position < this->text.size() && this->text[this->position] != '\0' && strchr(" \t\r\n", this->text[this->position]))
+            this->position++;
+        return this->position;
+    }
+
+    bool consume(char c)
+    {
+        if (this->skipSpace() >= this->text.size() || this->text[this->position] != c)
+            return false;
+        this->position++;
+        return true;
+    }
+
+    bool string()
+    {
+        if (!this->consume('"'))
+            return false;
+        while (this->position < this->text.size())
+        {
+            char c = this->text[this->position++];
+            if (c == '"')
+                return true;
+            if ((unsigned char)c < 0x20)
+                return false;
+            if (c == '\\' && !this->next("\"\\/bfnrtu"))
+                return false;
+        }
+        return false;
+    }
+
+    bool value(int depth)
+    {
+        if (depth > this->maxDepth || this->skipSpace() >= this->text.size())
+            return false;
+        char c = this->text[this->position];
+        if (c == '"')
+            return this->string();
+        if (c == '{' || c == '[')
+        {
+            char end = c == '{' ? '}' : ']';
+            this->position++;
+            if (this->consume(end))
+                return true;
+            do
+            {
+                if (c == '{' && (!this->string() || !this->consume(':')))
+                    return false;
+                if (!this->value(depth + 1))
+                    return false;
+            } while (this->consume(','));
+            return this->consume(end);
+        }
+        for (const char *literal : {"true", "false", "null"})
+        {
+            if (this->text.compare(this->position, strlen(literal), literal) == 0)
+            {
+                this->position += strlen(literal);
+                return true;
+            }
+        }
+        return this->number();
+    }
+
+    bool digits()
+    {
+        size_t start = this->position;
+        while (this->position < this->text.size() && isdigit((unsigned char)this->text[this->position]))
+            this->position++;
+        return this->position > start;
+    }
+
+    bool next(const char *characters)
+    {
+        if (this->position >= this->text.size() || this->text[this->position] == '\0' || !strchr(characters, this->text[this->position]))
+            return false;
+        this->position++;
+        return true;
+    }
+
+    // -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+    bool number()
+    {
+        this->next("-");
+        if (!this->next("0") && (this->position >= this->text.size() || this->text[this->position] == '0' || !this->digits()))
+            return false;
+        if (this->next(".") && !this->digits())
+            return false;
+        if (this->next("eE"))
+        {
+            this->next("+-");
+            if (!this->digits())
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif
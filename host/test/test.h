@@ -0,0 +1,54 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+
+// Just enough of a test framework for the host tests. Failed checks are reported and counted, and
+// TEST_MAIN's return value tells ctest whether there were any.
+
+namespace test
+{
+    inline int failures = 0;
+    inline int checks = 0;
+
+    inline bool check(bool passed, const char *file, int line, const char *expression)
+    {
+        checks++;
+        if (!passed)
+        {
+            failures++;
+            fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expression);
+        }
+        return passed;
+    }
+
+    inline bool checkEqual(long long expected, long long actual, const char *file, int line, const char *expression)
+    {
+        if (check(expected == actual, file, line, expression))
+            return true;
+        fprintf(stderr, "    expected %lld, got %lld\n", expected, actual);
+        return false;
+    }
+
+    inline int report(const char *name)
+    {
+        printf("%s: %d checks, %d failed\n", name, checks, failures);
+        return failures == 0 ? 0 : 1;
+    }
+}
+
+#define CHECK(expression) test::check((expression), __FILE__, __LINE__, #expression)
+
+#define CHECK_EQUAL(expected, actual) \
+    test::checkEqual((long long)(expected), (long long)(actual), __FILE__, __LINE__, #actual " == " #expected)
+
+#define RUN(function)                              \
+    do                                             \
+    {                                              \
+        int failuresBefore = test::failures;       \
+        function();                                \
+        if (test::failures != failuresBefore)      \
+            fprintf(stderr, "in %s\n", #function); \
+    } while (0)
+
+#endif
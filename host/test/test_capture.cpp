@@ -0,0 +1,156 @@
+#include "controller.h"
+#include "frames.h"
+#include "test.h"
+
+#include "capture.h"
+
+#include <string>
+#include <vector>
+
+static std::vector<std::string> lines(const std::string &payload)
+{
+    std::vector<std::string> lines;
+    size_t start = 0;
+    while (start < payload.size())
+    {
+        size_t end = payload.find('\n', start);
+        if (end == std::string::npos)
+            end = payload.size();
+        lines.push_back(payload.substr(start, end - start));
+        start = end + 1;
+    }
+    return lines;
+}
+
+// Lightbar.ino runs the capture's loop after the others.
+static void loop(Controller *controller, Capture *capture)
+{
+    controller->loop();
+    capture->loop();
+}
+
+static void receive(Controller *controller, Capture *capture, int packages)
+{
+    for (int i = 0; i < packages; i++)
+    {
+        byte raw[18];
+        frames::raw(raw, 0x123456, i, 0x01, 0x00);
+        fake::nrf24.receive(raw, sizeof(raw));
+        if (fake::nrf24.rx.size() == 3)
+            loop(controller, capture);
+    }
+    loop(controller, capture);
+}
+
+static void testPackagesArePublishedInBatches()
+{
+    fake::resetAll();
+    Controller controller(0, 0, false);
+    controller.settle();
+    Capture capture(&controller.radio, &controller.mqtt);
+    capture.setup(CAPTURE_TO_MQTT);
+    std::string topic = (controller.mqtt.getCombinedRootTopic() + "/capture").c_str();
+
+    // The first batch goes out right away, the rest waits for the publish interval.
+    receive(&controller, &capture, 4);
+    fake::advance(constants::CAPTURE_PUBLISH_INTERVAL * 1000);
+    loop(&controller, &capture);
+    std::vector<std::string> captured;
+    int messages = 0;
+    for (const fake::Message &message : fake::broker.published)
+    {
+        if (message.topic != topic)
+            continue;
+        messages++;
+        for (const std::string &line : lines(message.payload))
+            captured.push_back(line);
+    }
+    CHECK_EQUAL(2, messages);
+    CHECK_EQUAL(4, captured.size());
+    for (const std::string &line : captured)
+    {
+        size_t space = line.find(' ');
+        CHECK(space != std::string::npos && line.size() - space - 1 == 36);
+    }
+}
+
+// Without a broker, packages are only counted. Once connected again, their number is published, once.
+static void testDisconnectedCaptureOnlyCountsDrops()
+{
+    fake::resetAll();
+    Controller controller(0, 0, false);
+    controller.settle();
+    Capture capture(&controller.radio, &controller.mqtt);
+    capture.setup(CAPTURE_TO_MQTT);
+    std::string topic = (controller.mqtt.getCombinedRootTopic() + "/capture").c_str();
+
+    fake::broker.online = false;
+    fake::broker.disconnectAll();
+    const int PACKAGES = 10 * constants::CAPTURE_BATCH_SIZE;
+    for (int i = 0; i < PACKAGES / 3; i++)
+    {
+        receive(&controller, &capture, 3);
+        fake::advance(constants::CAPTURE_PUBLISH_INTERVAL * 1000);
+    }
+    CHECK(!controller.mqtt.isConnected());
+    CHECK(fake::broker.last(topic) == nullptr);
+
+    fake::broker.online = true;
+    size_t before = fake::broker.published.size();
+    for (int i = 0; i < 100; i++)
+    {
+        loop(&controller, &capture);
+        fake::advance(100000);
+    }
+    CHECK(controller.mqtt.isConnected());
+
+    std::vector<std::string> published;
+    for (size_t i = before; i < fake::broker.published.size(); i++)
+    {
+        if (fake::broker.published[i].topic == topic)
+            published.push_back(fake::broker.published[i].payload);
+    }
+    if (!CHECK_EQUAL(1, published.size()))
+        return;
+    CHECK(published[0] == "dropped " + std::to_string(PACKAGES / 3 * 3) + "\n");
+}
+
+// A batch that failed to publish is sent again later, with a single line for everything dropped meanwhile.
+static void testFailedPublishIsRetried()
+{
+    fake::resetAll();
+    Controller controller(0, 0, false);
+    controller.settle();
+    Capture capture(&controller.radio, &controller.mqtt);
+    capture.setup(CAPTURE_TO_MQTT);
+    std::string topic = (controller.mqtt.getCombinedRootTopic() + "/capture").c_str();
+
+    fake::broker.failWrites = true;
+    const int LOOPS = 10 * constants::CAPTURE_BATCH_SIZE;
+    for (int i = 0; i < LOOPS; i++)
+    {
+        receive(&controller, &capture, 3);
+        fake::advance(constants::CAPTURE_PUBLISH_INTERVAL * 1000);
+    }
+    CHECK(fake::broker.last(topic) == nullptr);
+
+    fake::broker.failWrites = false;
+    loop(&controller, &capture);
+    const fake::Message *message = fake::broker.last(topic);
+    if (!CHECK(message != nullptr))
+        return;
+    std::vector<std::string> captured = lines(message->payload);
+    CHECK(captured.size() <= constants::CAPTURE_BATCH_SIZE + 1);
+    CHECK(captured.back() == "dropped " + std::to_string(LOOPS * 3 - (captured.size() - 1)));
+    for (size_t i = 0; i + 1 < captured.size(); i++)
+        CHECK(captured[i].rfind("dropped", 0) != 0);
+}
+
+int main()
+{
+    fake::quiet = true;
+    RUN(testPackagesArePublishedInBatches);
+    RUN(testDisconnectedCaptureOnlyCountsDrops);
+    RUN(testFailedPublishIsRetried);
+    return test::report("test_capture");
+}
@@ -0,0 +1,62 @@
+#include "frames.h"
+#include "test.h"
+
+#include "checksum.h"
+
+// The table-driven CRC has to give the same result as the bitwise one the CRC library computed.
+static void testCrc16MatchesBitwise()
+{
+    srand(3);
+    for (int i = 0; i < 10000; i++)
+    {
+        byte data[64];
+        size_t length = rand() % sizeof(data);
+        for (size_t j = 0; j < length; j++)
+            data[j] = rand();
+        CHECK_EQUAL(frames::crc16(data, length), checksum::crc16(data, length));
+    }
+}
+
+static void testCrc16Continues()
+{
+    srand(4);
+    for (int i = 0; i < 1000; i++)
+    {
+        byte data[17];
+        for (size_t j = 0; j < sizeof(data); j++)
+            data[j] = rand();
+        size_t split = rand() % sizeof(data);
+        uint16_t prefix = checksum::crc16(data, split);
+        CHECK_EQUAL(checksum::crc16(data, sizeof(data)), checksum::crc16(data + split, sizeof(data) - split, prefix));
+    }
+}
+
+static void testCrc16Table()
+{
+    for (int i = 0; i < 256; i++)
+    {
+        byte value = i;
+        // A single byte with an initial value of 0 leaves just the table entry.
+        CHECK_EQUAL(checksum::CRC16_TABLE.values[i], checksum::crc16(&value, 1, 0));
+    }
+    CHECK_EQUAL(0x0000, checksum::CRC16_TABLE.values[0]);
+    CHECK_EQUAL(checksum::CRC16_POLYNOMIAL, checksum::CRC16_TABLE.values[1]);
+}
+
+// Test vectors from the FNV reference implementation.
+static void testFnv1a()
+{
+    CHECK_EQUAL(0x811c9dc5, checksum::fnv1a((const byte *)"", 0));
+    CHECK_EQUAL(0xe40c292c, checksum::fnv1a((const byte *)"a", 1));
+    CHECK_EQUAL(0xbf9cf968, checksum::fnv1a((const byte *)"foobar", 6));
+    CHECK_EQUAL(0xbf9cf968, checksum::fnv1a((const byte *)"bar", 3, checksum::fnv1a((const byte *)"foo", 3)));
+}
+
+int main()
+{
+    RUN(testCrc16MatchesBitwise);
+    RUN(testCrc16Continues);
+    RUN(testCrc16Table);
+    RUN(testFnv1a);
+    return test::report("test_checksum");
+}
@@ -0,0 +1,241 @@
+#include "json.h"
+#include "test.h"
+
+#include "command.h"
+
+#include <vector>
+
+// Parses from a buffer of exactly the payload's size, like PubSubClient hands it over: not terminated.
+static bool parse(const std::string &payload, LightbarCommand *command)
+{
+    std::vector<byte> buffer(payload.begin(), payload.end());
+    return parseLightbarCommand(buffer.data(), buffer.size(), command);
+}
+
+static void testHomeAssistantCommands()
+{
+    LightbarCommand command;
+    CHECK(parse("{\"state\":\"ON\"}", &command));
+    CHECK(command.hasState && command.state);
+    CHECK(!command.hasBrightness && !command.hasColorTemp && !command.hasTransition);
+
+    CHECK(parse("{\"state\":\"OFF\",\"brightness\":128}", &command));
+    CHECK(command.hasState && !command.state);
+    CHECK(command.hasBrightness);
+    CHECK_EQUAL(128, command.brightness);
+
+    CHECK(parse("{\"brightness\": 255, \"color_temp\": 370, \"transition\": 2.5}", &command));
+    CHECK_EQUAL(255, command.brightness);
+    CHECK(command.hasColorTemp);
+    CHECK_EQUAL(370, command.colorTemp);
+    CHECK(command.hasTransition && command.transition == 2.5f);
+
+    CHECK(parse(" {\n  \"state\" : \"ON\" ,\r\n\t\"color_temp\":153 }\n", &command));
+    CHECK(command.hasState && command.state);
+    CHECK_EQUAL(153, command.colorTemp);
+
+    CHECK(parse("{}", &command));
+    CHECK(!command.hasState && !command.hasBrightness && !command.hasColorTemp && !command.hasTransition);
+}
+
+static void testNumbersAreClamped()
+{
+    LightbarCommand command;
+    CHECK(parse("{\"brightness\":300}", &command));
+    CHECK_EQUAL(255, command.brightness);
+    CHECK(parse("{\"brightness\":-5}", &command));
+    CHECK_EQUAL(0, command.brightness);
+    CHECK(parse("{\"brightness\":12.7}", &command));
+    CHECK_EQUAL(12, command.brightness);
+    CHECK(parse("{\"brightness\":1e2}", &command));
+    CHECK_EQUAL(100, command.brightness);
+    CHECK(parse("{\"color_temp\":70000}", &command));
+    CHECK_EQUAL(65535, command.colorTemp);
+    CHECK(parse("{\"transition\":-1}", &command));
+    CHECK(command.hasTransition && command.transition == 0);
+}
+
+static void testUnknownKeysAreSkipped()
+{
+    LightbarCommand command;
+    CHECK(parse("{\"effect\":\"colorloop\",\"color\":{\"r\":1,\"g\":[1,2,{\"a\":null}]},\"flash\":true,\"state\":\"ON\"}", &command));
+    CHECK(command.hasState && command.state);
+
+    CHECK(parse("{\"x\":\"a\\\"b,\\\\\",\"state\":\"ON\"}", &command));
+    CHECK(command.hasState && command.state);
+
+    // Known keys with values of the wrong type are skipped as well.
+    CHECK(parse("{\"brightness\":\"12\",\"state\":true,\"color_temp\":[1]}", &command));
+    CHECK(!command.hasBrightness && !command.hasState && !command.hasColorTemp);
+}
+
+static void testMalformedCommandsAreRejected()
+{
+    const char *const malformed[] = {
+        "",
+        "{",
+        "}",
+        "[]",
+        "\"ON\"",
+        "null",
+        "{\"state\":}",
+        "{\"state\":\"ON\",}",
+        "{\"state\":\"ON\"} x",
+        "{\"state\":\"ON\"}{}",
+        "{\"state\" \"ON\"}",
+        "{'state':'ON'}",
+        "{state:\"ON\"}",
+        "{\"state\":\"ON",
+        "{\"state\":\"ON\\\"}",
+        "{\"brightness\":12",
+        "{\"brightness\":1-}",
+        "{\"brightness\":-}",
+        "{\"a\":[1,2}",
+        "{\"a\":{\"b\":1]}",
+        "{\"a\":tru}",
+        "{\"a\":nul}",
+        "{\"a\":[[[[[[[[[1]]]]]]]]]}",
+        "{\"brightness\":1234567890123456789012345678}",
+    };
+    for (const char *payload : malformed)
+    {
+        LightbarCommand command;
+        if (!CHECK(!parse(payload, &command)))
+            fprintf(stderr, "    accepted %s\n", payload);
+    }
+
+    // Nesting up to the parser's limit is fine.
+    LightbarCommand command;
+    CHECK(parse("{\"a\":[[[[[[[1]]]]]]],\"state\":\"ON\"}", &command));
+    CHECK(command.hasState);
+}
+
+static std::string ws()
+{
+    const char *const space[] = {"", " ", "\n", " \t "};
+    return space[rand() % 4];
+}
+
+// Random commands like Home Assistant and other clients send them, with the fields the parser must find.
+static std::string generateCommand(LightbarCommand *expected)
+{
+    *expected = LightbarCommand();
+    std::vector<std::string> members;
+
+    if (rand() % 2)
+    {
+        expected->hasState = true;
+        expected->state = rand() % 2;
+        members.push_back("\"state\"" + ws() + ":" + ws() + (expected->state ? "\"ON\"" : "\"OFF\""));
+    }
+    if (rand() % 2)
+    {
+        expected->hasBrightness = true;
+        expected->brightness = rand() % 256;
+        members.push_back("\"brightness\":" + ws() + std::to_string(expected->brightness));
+    }
+    if (rand() % 2)
+    {
+        expected->hasColorTemp = true;
+        expected->colorTemp = 153 + rand() % 348;
+        members.push_back("\"color_temp\":" + std::to_string(expected->colorTemp) + ws());
+    }
+    if (rand() % 3 == 0)
+        members.push_back("\"effect\":" + ws() + "\"none\"");
+    if (rand() % 3 == 0)
+        members.push_back("\"color\":{\"h\":" + std::to_string(rand() % 360) + ",\"s\":[1.5,-2e3,true,null]}");
+
+    for (size_t i = members.size(); i > 1; i--)
+        std::swap(members[i - 1], members[rand() % i]);
+    std::string payload = ws() + "{";
+    for (size_t i = 0; i < members.size(); i++)
+        payload += (i > 0 ? "," : "") + ws() + members[i] + ws();
+    return payload + "}" + ws();
+}
+
+static void testGeneratedCommands()
+{
+    srand(5);
+    for (int i = 0; i < 20000; i++)
+    {
+        LightbarCommand expected;
+        std::string payload = generateCommand(&expected);
+        LightbarCommand command;
+        if (!CHECK(parse(payload, &command)))
+        {
+            fprintf(stderr, "    %s\n", payload.c_str());
+            continue;
+        }
+        CHECK_EQUAL(expected.hasState, command.hasState);
+        CHECK_EQUAL(expected.state, command.state);
+        CHECK_EQUAL(expected.hasBrightness, command.hasBrightness);
+        CHECK_EQUAL(expected.brightness, command.brightness);
+        CHECK_EQUAL(expected.hasColorTemp, command.hasColorTemp);
+        CHECK_EQUAL(expected.colorTemp, command.colorTemp);
+    }
+}
+
+// Commands that still are well-formed JSON objects after a mutation have to be accepted. Everything
+// else only must not make the parser read past the payload, which a build with -DSANITIZE=ON checks.
+static void testMutatedCommands()
+{
+    const char alphabet[] = "{}[]\":,0123456789.-+eE tfnrul\\ab";
+    srand(6);
+    int stillValid = 0;
+    for (int i = 0; i < 200000; i++)
+    {
+        LightbarCommand expected;
+        std::string payload = generateCommand(&expected);
+        for (int mutations = 1 + rand() % 3; mutations > 0 && !payload.empty(); mutations--)
+        {
+            size_t position = rand() % payload.size();
+            switch (rand() % 4)
+            {
+            case 0:
+                payload[position] = alphabet[rand() % (sizeof(alphabet) - 1)];
+                break;
+            case 1:
+                payload.erase(position, 1);
+                break;
+            case 2:
+                payload.insert(position, 1, alphabet[rand() % (sizeof(alphabet) - 1)]);
+                break;
+            default:
+                payload.resize(position);
+                break;
+            }
+        }
+
+        LightbarCommand command;
+        bool accepted = parse(payload, &command);
+
+        // The parser reads numbers of up to 24 characters only.
+        bool longNumber = false;
+        int run = 0;
+        for (char c : payload)
+        {
+            run = c != '\0' && strchr("0123456789.-+eE", c) != nullptr ? run + 1 : 0;
+            longNumber = longNumber || run >= 24;
+        }
+        size_t start = payload.find_first_not_of(" \t\r\n");
+        bool isObject = start != std::string::npos && payload[start] == '{';
+        if (isObject && !longNumber && JsonChecker(payload, 8).valid())
+        {
+            stillValid++;
+            if (!CHECK(accepted))
+                fprintf(stderr, "    %s\n", payload.c_str());
+        }
+    }
+    CHECK(stillValid > 1000);
+}
+
+int main()
+{
+    RUN(testHomeAssistantCommands);
+    RUN(testNumbersAreClamped);
+    RUN(testUnknownKeysAreSkipped);
+    RUN(testMalformedCommandsAreRejected);
+    RUN(testGeneratedCommands);
+    RUN(testMutatedCommands);
+    return test::report("test_command");
+}
@@ -0,0 +1,220 @@
+#include "controller.h"
+#include "json.h"
+#include "test.h"
+
+#include "discovery.h"
+
+// 2 messages per light bar, 7 per remote and 8 for the diagnostics.
+static size_t expectedMessages(uint8_t lightbars, uint8_t remotes)
+{
+    return 2 * lightbars + 7 * remotes + (constants::METRICS_DISCOVERY ? 8 : 0);
+}
+
+static bool isDiscovery(const fake::Message &message)
+{
+    return message.topic.rfind("homeassistant/", 0) == 0 && message.topic.find("/config") != std::string::npos;
+}
+
+static size_t countDiscovery(size_t from = 0)
+{
+    size_t count = 0;
+    for (size_t i = from; i < fake::broker.published.size(); i++)
+        count += isDiscovery(fake::broker.published[i]);
+    return count;
+}
+
+static void testTemplatesRenderValidJson()
+{
+    PGM_P parts[] = {discovery::LIGHTBAR_CONFIG, discovery::PAIR_CONFIG, discovery::REMOTE_CONFIG, discovery::ACTION_CONFIG};
+    discovery::Values values = {"l2m_0200C0FFEE", "lightbar2mqtt/l2m_0200C0FFEE", "0x100000", "Desk", discovery::LIGHTBAR_MODEL, "press"};
+
+    for (PGM_P part : parts)
+    {
+        std::string payload;
+        struct : Print
+        {
+            std::string *payload;
+            size_t write(uint8_t c) override
+            {
+                this->payload->push_back(c);
+                return 1;
+            }
+        } output;
+        output.payload = &payload;
+
+        size_t length = discovery::measure(discovery::BASE_CONFIG, values) + discovery::measure(part, values);
+        size_t written = discovery::render(&output, discovery::BASE_CONFIG, values) + discovery::render(&output, part, values);
+        CHECK_EQUAL(length, payload.size());
+        CHECK_EQUAL(length, written);
+        if (!CHECK(JsonChecker(payload).valid()))
+            fprintf(stderr, "    %s\n", payload.c_str());
+    }
+}
+
+static void testAllMessagesArePublished()
+{
+    fake::resetAll();
+    Controller controller(constants::MAX_LIGHTBARS, constants::MAX_REMOTES);
+    controller.settle();
+
+    CHECK_EQUAL(expectedMessages(constants::MAX_LIGHTBARS, constants::MAX_REMOTES), countDiscovery());
+    for (const fake::Message &message : fake::broker.published)
+    {
+        if (!isDiscovery(message))
+            continue;
+        CHECK(message.retained);
+        if (!CHECK(JsonChecker(message.payload).valid()))
+            fprintf(stderr, "    %s: %s\n", message.topic.c_str(), message.payload.c_str());
+    }
+
+    // The broker drops the connection if a payload does not match its announced length.
+    CHECK(controller.mqtt.isConnected());
+    CHECK_EQUAL(1, fake::broker.connects);
+}
+
+// The job may only exceed the byte budget of a loop by the message that crossed it.
+static void testDiscoveryIsPaced()
+{
+    fake::resetAll();
+    Controller controller(constants::MAX_LIGHTBARS, constants::MAX_REMOTES);
+
+    int loops = 0;
+    size_t largest = 0;
+    size_t mostPerLoop = 0;
+    while (countDiscovery() < expectedMessages(constants::MAX_LIGHTBARS, constants::MAX_REMOTES) && loops < 100)
+    {
+        size_t before = fake::broker.published.size();
+        controller.loop();
+        loops++;
+
+        size_t bytes = 0;
+        for (size_t i = before; i < fake::broker.published.size(); i++)
+        {
+            if (!isDiscovery(fake::broker.published[i]))
+                continue;
+            bytes += fake::broker.published[i].payload.size();
+            largest = max(largest, fake::broker.published[i].payload.size());
+        }
+        mostPerLoop = max(mostPerLoop, bytes);
+    }
+
+    CHECK(loops > 1);
+    CHECK(mostPerLoop < constants::DISCOVERY_BYTES_PER_LOOP + largest);
+    CHECK_EQUAL(expectedMessages(constants::MAX_LIGHTBARS, constants::MAX_REMOTES), countDiscovery());
+}
+
+static void testUnchangedMessagesAreSkipped()
+{
+    fake::resetAll();
+    {
+        Controller controller(2, 2);
+        controller.settle();
+        CHECK_EQUAL(expectedMessages(2, 2), countDiscovery());
+    }
+
+    // After a restart, the hashes in flash tell that nothing changed.
+    fake::broker.reset();
+    Controller controller(2, 2);
+    controller.settle();
+    CHECK_EQUAL(0, countDiscovery());
+
+    // Home Assistant coming back online wants to see all of them again.
+    size_t before = fake::broker.published.size();
+    fake::broker.publish("homeassistant/status", "online");
+    controller.settle();
+    CHECK_EQUAL(expectedMessages(2, 2), countDiscovery(before));
+}
+
+// A connection lost in the middle of the job restarts it once connected again. What already went out
+// is not published twice.
+static void testInterruptedDiscoveryIsResumed()
+{
+    fake::resetAll();
+    Controller controller(constants::MAX_LIGHTBARS, constants::MAX_REMOTES);
+    controller.loop();
+    size_t published = countDiscovery();
+    CHECK(published > 0);
+    CHECK(published < expectedMessages(constants::MAX_LIGHTBARS, constants::MAX_REMOTES));
+
+    fake::broker.disconnectAll();
+    controller.settle();
+    CHECK(controller.mqtt.isConnected());
+    CHECK_EQUAL(2, fake::broker.connects);
+    CHECK_EQUAL(expectedMessages(constants::MAX_LIGHTBARS, constants::MAX_REMOTES), countDiscovery());
+
+    std::vector<std::string> topics;
+    for (const fake::Message &message : fake::broker.published)
+    {
+        if (isDiscovery(message))
+            topics.push_back(message.topic);
+    }
+    std::sort(topics.begin(), topics.end());
+    CHECK(std::adjacent_find(topics.begin(), topics.end()) == topics.end());
+}
+
+// PubSubClient's endPublish() reports success even if the payload never made it out, so such messages
+// must not end up in the cache.
+static void testFailedMessagesAreRetried()
+{
+    fake::resetAll();
+    fake::broker.failWrites = true;
+    {
+        Controller controller(2, 2);
+        controller.settle();
+        CHECK_EQUAL(0, countDiscovery());
+        CHECK(controller.mqtt.getStats().publish_failures >= expectedMessages(2, 2));
+    }
+
+    fake::broker.reset();
+    Controller controller(2, 2);
+    controller.settle();
+    CHECK_EQUAL(expectedMessages(2, 2), countDiscovery());
+}
+
+// Hashes of topics that are gone make room for the new ones, once a whole job did without them.
+static void testRemovedSerialsAreDropped()
+{
+    auto boot = [](uint32_t firstRemote)
+    {
+        fake::broker.reset();
+        Controller controller(constants::MAX_LIGHTBARS, 0);
+        Remote *remotes[constants::MAX_REMOTES];
+        for (uint8_t i = 0; i < constants::MAX_REMOTES; i++)
+        {
+            remotes[i] = new Remote(&controller.radio, firstRemote + i, "Remote");
+            controller.mqtt.addRemote(remotes[i]);
+        }
+        controller.settle();
+        for (Remote *remote : remotes)
+        {
+            controller.mqtt.removeRemote(remote);
+            controller.radio.removeRemote(remote);
+            delete remote;
+        }
+        return countDiscovery();
+    };
+
+    fake::resetAll();
+    size_t all = expectedMessages(constants::MAX_LIGHTBARS, constants::MAX_REMOTES);
+    CHECK_EQUAL(all, boot(0x200000));
+    CHECK_EQUAL(0, boot(0x200000));
+
+    // The remotes were replaced. Their messages don't fit into the cache until the old ones are gone.
+    size_t remotes = expectedMessages(0, constants::MAX_REMOTES) - expectedMessages(0, 0);
+    CHECK_EQUAL(remotes, boot(0x300000));
+    CHECK_EQUAL(remotes - (constants::DISCOVERY_CACHE_SIZE - all), boot(0x300000));
+    CHECK_EQUAL(0, boot(0x300000));
+}
+
+int main()
+{
+    fake::quiet = true;
+    RUN(testTemplatesRenderValidJson);
+    RUN(testAllMessagesArePublished);
+    RUN(testDiscoveryIsPaced);
+    RUN(testUnchangedMessagesAreSkipped);
+    RUN(testInterruptedDiscoveryIsResumed);
+    RUN(testFailedMessagesAreRetried);
+    RUN(testRemovedSerialsAreDropped);
+    return test::report("test_discovery");
+}
@@ -0,0 +1,188 @@
+#include "frames.h"
+#include "test.h"
+
+#include "lightbar.h"
+#include "radio.h"
+#include "registry.h"
+#include "remote.h"
+
+#include <utility>
+#include <vector>
+
+static const uint32_t LIGHTBAR_SERIAL = 0x123456;
+
+typedef std::vector<std::pair<byte, byte>> Frames;
+
+struct Fixture
+{
+    Registry registry;
+    Radio radio;
+    Lightbar lightbar;
+
+    Fixture() : radio(&registry, 1, 2), lightbar(&radio, LIGHTBAR_SERIAL, "Light bar")
+    {
+        fake::nrf24.reset();
+        this->radio.setup();
+    }
+
+    // Lets the radio send everything pending and returns each frame's command and options once.
+    Frames send()
+    {
+        size_t written = fake::nrf24.tx.size();
+        for (int i = 0; i < 10000 && (this->lightbar.hasPendingCommands() || !fake::nrf24.listening); i++)
+        {
+            this->radio.loop();
+            fake::advance(1000);
+        }
+        CHECK(!this->lightbar.hasPendingCommands() && fake::nrf24.listening);
+
+        Frames frames;
+        int sequence = -1;
+        for (size_t i = written; i < fake::nrf24.tx.size(); i++)
+        {
+            const byte *data = fake::nrf24.tx[i].data;
+            if (data[12] == sequence)
+                continue;
+            sequence = data[12];
+            frames.push_back({data[13], data[14]});
+        }
+        return frames;
+    }
+};
+
+static void checkFrames(const Frames &expected, const Frames &actual, int line)
+{
+    if (test::check(expected == actual, __FILE__, line, "sent frames"))
+        return;
+    fprintf(stderr, "    expected");
+    for (const auto &frame : expected)
+        fprintf(stderr, " %02X/%02X", frame.first, frame.second);
+    fprintf(stderr, ", got");
+    for (const auto &frame : actual)
+        fprintf(stderr, " %02X/%02X", frame.first, frame.second);
+    fprintf(stderr, "\n");
+}
+
+#define CHECK_FRAMES(expected, actual) checkFrames(expected, actual, __LINE__)
+
+// The first change goes all the way down and up from there. Later ones are relative, with steps down
+// counted as negative numbers, like the all the way down frame.
+static void testAnchorThenDelta()
+{
+    Fixture fixture;
+    fixture.lightbar.setBrightness(10);
+    CHECK_FRAMES(Frames({{Lightbar::Command::DIMMER, 0xF0}, {Lightbar::Command::BRIGHTER, 10}}), fixture.send());
+    fixture.lightbar.setBrightness(13);
+    CHECK_FRAMES(Frames({{Lightbar::Command::BRIGHTER, 3}}), fixture.send());
+    fixture.lightbar.setBrightness(5);
+    CHECK_FRAMES(Frames({{Lightbar::Command::DIMMER, 0xF8}}), fixture.send());
+
+    fixture.lightbar.setTemperature(7);
+    CHECK_FRAMES(Frames({{Lightbar::Command::COOLER, 0xF0}, {Lightbar::Command::WARMER, 7}}), fixture.send());
+    fixture.lightbar.setTemperature(9);
+    CHECK_FRAMES(Frames({{Lightbar::Command::WARMER, 2}}), fixture.send());
+    fixture.lightbar.setTemperature(4);
+    CHECK_FRAMES(Frames({{Lightbar::Command::COOLER, 0xFB}}), fixture.send());
+}
+
+static void testUnchangedValueSendsNothing()
+{
+    Fixture fixture;
+    fixture.lightbar.setBrightness(8);
+    fixture.lightbar.setTemperature(3);
+    fixture.send();
+
+    fixture.lightbar.setBrightness(8);
+    fixture.lightbar.setTemperature(3);
+    CHECK_FRAMES(Frames(), fixture.send());
+
+    // Only the last of several changes before the radio is free counts.
+    fixture.lightbar.setBrightness(12);
+    fixture.lightbar.setBrightness(8);
+    CHECK_FRAMES(Frames(), fixture.send());
+}
+
+// A remote sharing the light bar's serial changes it behind our back.
+static void testSharedSerialRemoteInvalidates()
+{
+    Fixture fixture;
+    Remote remote(&fixture.radio, LIGHTBAR_SERIAL, "Remote");
+    fixture.lightbar.setBrightness(8);
+    fixture.lightbar.setTemperature(3);
+    fixture.send();
+
+    byte raw[18];
+    frames::raw(raw, LIGHTBAR_SERIAL, 100, Lightbar::Command::BRIGHTER, 0x01);
+    fake::nrf24.receive(raw, sizeof(raw));
+    fixture.radio.loop();
+
+    fixture.lightbar.setBrightness(9);
+    fixture.lightbar.setTemperature(4);
+    CHECK_FRAMES(Frames({{Lightbar::Command::DIMMER, 0xF0}, {Lightbar::Command::BRIGHTER, 9},
+                         {Lightbar::Command::COOLER, 0xF0}, {Lightbar::Command::WARMER, 4}}),
+                 fixture.send());
+    fixture.radio.removeRemote(&remote);
+}
+
+// Brightness and color temperature are trusted for a while after each of them was last sent as an
+// absolute value, independently of each other.
+static void testResyncInterval()
+{
+    Fixture fixture;
+    fixture.lightbar.setTemperature(3);
+    fixture.send();
+
+    fake::advance(constants::LIGHTBAR_RESYNC_INTERVAL * 600);
+    fixture.lightbar.setBrightness(8);
+    fixture.lightbar.setTemperature(4);
+    CHECK_FRAMES(Frames({{Lightbar::Command::DIMMER, 0xF0}, {Lightbar::Command::BRIGHTER, 8},
+                         {Lightbar::Command::WARMER, 1}}),
+                 fixture.send());
+
+    fake::advance(constants::LIGHTBAR_RESYNC_INTERVAL * 600);
+    fixture.lightbar.setBrightness(9);
+    fixture.lightbar.setTemperature(5);
+    CHECK_FRAMES(Frames({{Lightbar::Command::BRIGHTER, 1},
+                         {Lightbar::Command::COOLER, 0xF0}, {Lightbar::Command::WARMER, 5}}),
+                 fixture.send());
+}
+
+// Every kind of command has its latency measured, from the request to its frame going on air.
+static void testCommandLatencyIsMeasured()
+{
+    Fixture fixture;
+    const Histogram &latency = fixture.radio.getStats().command_latency;
+
+    fixture.lightbar.onOff();
+    fake::advance(5000);
+    CHECK_FRAMES(Frames({{Lightbar::Command::ON_OFF, 0x00}}), fixture.send());
+    CHECK_EQUAL(1, latency.count);
+    CHECK(latency.max >= 5000);
+
+    fixture.lightbar.setOnOff(true);
+    fixture.send();
+    fixture.lightbar.setBrightness(4);
+    fixture.send();
+    CHECK_EQUAL(3, latency.count);
+
+    // Toggling back before anything was sent leaves nothing to measure, and a command sent right away
+    // took next to no time.
+    fixture.lightbar.onOff();
+    fixture.lightbar.onOff();
+    fake::advance(5000);
+    fixture.lightbar.setBrightness(6);
+    fixture.send();
+    CHECK_EQUAL(4, latency.count);
+    CHECK(latency.max < 5000 + 1000 * 10);
+}
+
+int main()
+{
+    fake::quiet = true;
+    RUN(testAnchorThenDelta);
+    RUN(testUnchangedValueSendsNothing);
+    RUN(testSharedSerialRemoteInvalidates);
+    RUN(testResyncInterval);
+    RUN(testCommandLatencyIsMeasured);
+    return test::report("test_lightbar");
+}
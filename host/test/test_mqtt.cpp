@@ -0,0 +1,166 @@
+#include "controller.h"
+#include "frames.h"
+#include "test.h"
+
+#include <string>
+#include <vector>
+
+static uint8_t sequence = 0;
+
+// Receives a frame of the remote and lets the controller handle it.
+static void press(Controller *controller, byte command, byte options = 0x00)
+{
+    byte raw[18];
+    frames::raw(raw, Controller::FIRST_REMOTE, ++sequence, command, options);
+    fake::nrf24.receive(raw, sizeof(raw));
+    controller->loop();
+}
+
+// Lets the given number of milliseconds pass, running the loop every millisecond.
+static void wait(Controller *controller, unsigned long ms)
+{
+    controller->settle(1000, ms);
+}
+
+static std::vector<std::string> published(Controller *controller, const char *action, size_t from)
+{
+    std::string topic = controller->topic(Controller::FIRST_REMOTE, action).c_str();
+    std::vector<std::string> payloads;
+    for (size_t i = from; i < fake::broker.published.size(); i++)
+    {
+        if (fake::broker.published[i].topic == topic)
+            payloads.push_back(fake::broker.published[i].payload);
+    }
+    return payloads;
+}
+
+// A press is reported on the state topic and cleared again shortly after.
+static void testPressIsCleared()
+{
+    fake::resetAll();
+    Controller controller(0, 1, false);
+    controller.settle();
+    size_t start = fake::broker.published.size();
+    press(&controller, Lightbar::Command::ON_OFF);
+    CHECK(published(&controller, "state", start) == std::vector<std::string>({"press"}));
+    wait(&controller, constants::ACTION_CLEAR_DELAY - 10);
+    CHECK_EQUAL(1, published(&controller, "state", start).size());
+    wait(&controller, 20);
+    CHECK(published(&controller, "state", start) == std::vector<std::string>({"press", ""}));
+    CHECK_EQUAL(0, published(&controller, "action", start).size());
+}
+
+// Steps within the aggregation window make up one turn, reported once on the state topic and published
+// with its steps, duration and rate when it is over.
+static void testStepsAreAggregated()
+{
+    fake::resetAll();
+    Controller controller(0, 1, false);
+    controller.settle();
+    size_t start = fake::broker.published.size();
+    for (int i = 0; i < 5; i++)
+    {
+        if (i > 0)
+            wait(&controller, 40);
+        press(&controller, Lightbar::Command::BRIGHTER);
+    }
+    CHECK(published(&controller, "state", start) == std::vector<std::string>({"turn_clockwise"}));
+    wait(&controller, constants::ROTARY_AGGREGATION_WINDOW - 10);
+    CHECK_EQUAL(0, published(&controller, "action", start).size());
+
+    wait(&controller, 20);
+    CHECK(published(&controller, "state", start) == std::vector<std::string>({"turn_clockwise", ""}));
+    CHECK(published(&controller, "action", start) == std::vector<std::string>({"{\"action\":\"turn_clockwise\",\"steps\":5,\"duration\":160,\"rate\":25.0}"}));
+}
+
+// A frame carries a signed number of steps, all of which count.
+static void testFramesWithSeveralSteps()
+{
+    fake::resetAll();
+    Controller controller(0, 1, false);
+    controller.settle();
+    size_t start = fake::broker.published.size();
+    press(&controller, Lightbar::Command::DIMMER, (byte)-3);
+    wait(&controller, 100);
+    press(&controller, Lightbar::Command::DIMMER, (byte)-2);
+    wait(&controller, 100);
+    press(&controller, Lightbar::Command::DIMMER, 0x00);
+    wait(&controller, constants::ROTARY_AGGREGATION_WINDOW + 10);
+    CHECK(published(&controller, "action", start) == std::vector<std::string>({"{\"action\":\"turn_counterclockwise\",\"steps\":6,\"duration\":200,\"rate\":15.0}"}));
+
+    press(&controller, Lightbar::Command::WARMER, 4);
+    wait(&controller, constants::ROTARY_AGGREGATION_WINDOW + 10);
+    CHECK_EQUAL(2, published(&controller, "action", start).size());
+    CHECK(published(&controller, "action", start).back() == "{\"action\":\"press_turn_counterclockwise\",\"steps\":4,\"duration\":0,\"rate\":0.0}");
+}
+
+// Changing the direction or pausing for longer than the window starts a new turn.
+static void testTurnsAreSeparated()
+{
+    fake::resetAll();
+    Controller controller(0, 1, false);
+    controller.settle();
+    size_t start = fake::broker.published.size();
+    press(&controller, Lightbar::Command::BRIGHTER);
+    wait(&controller, 50);
+    press(&controller, Lightbar::Command::BRIGHTER);
+    wait(&controller, 50);
+    press(&controller, Lightbar::Command::DIMMER);
+    wait(&controller, constants::ROTARY_AGGREGATION_WINDOW + 10);
+    press(&controller, Lightbar::Command::DIMMER);
+    wait(&controller, constants::ROTARY_AGGREGATION_WINDOW + 10);
+
+    CHECK(published(&controller, "action", start) == std::vector<std::string>({"{\"action\":\"turn_clockwise\",\"steps\":2,\"duration\":50,\"rate\":20.0}",
+                                                         "{\"action\":\"turn_counterclockwise\",\"steps\":1,\"duration\":0,\"rate\":0.0}",
+                                                         "{\"action\":\"turn_counterclockwise\",\"steps\":1,\"duration\":0,\"rate\":0.0}"}));
+    CHECK(published(&controller, "state", start) == std::vector<std::string>({"turn_clockwise", "turn_counterclockwise", "", "turn_counterclockwise", ""}));
+}
+
+// Messages are only routed for topics with the serial written the way the controller subscribes and
+// announces it.
+static bool routes(Controller *controller, Lightbar *lightbar, const char *serial)
+{
+    std::string topic = std::string(controller->mqtt.getCombinedRootTopic().c_str()) + "/" + serial + "/pair";
+    std::vector<char> topicBuffer(topic.begin(), topic.end());
+    topicBuffer.push_back('\0');
+    controller->mqtt.onMessage(topicBuffer.data(), nullptr, 0);
+    bool routed = lightbar->hasPendingCommands();
+    controller->settle();
+    return routed;
+}
+
+static void testTopicSerialParsing()
+{
+    fake::resetAll();
+    Controller controller(1, 0, false);
+    Lightbar lightbar(&controller.radio, 0xabcdef, "Light bar");
+    controller.mqtt.addLightbar(&lightbar);
+    controller.settle();
+
+    CHECK(routes(&controller, controller.lightbars[0], "0x100000"));
+    CHECK(routes(&controller, &lightbar, "0xabcdef"));
+
+    const char *const rejected[] = {"0xABCDEF", "0xabcDEF", "0x0abcdef", "0x00abcdef", "0x+abcdef", "0x abcdef",
+                                    "0x0xabcdef", "0X abcdef", "abcdef", "0x", "0x1abcdef", "0x100abcdef", "0xabcdef0"};
+    for (const char *serial : rejected)
+    {
+        if (!CHECK(!routes(&controller, &lightbar, serial)))
+            fprintf(stderr, "    routed %s\n", serial);
+    }
+    CHECK(!routes(&controller, controller.lightbars[0], "0x0100000"));
+    CHECK(!routes(&controller, controller.lightbars[0], "0x100100000"));
+
+    controller.mqtt.removeLightbar(&lightbar);
+    controller.radio.removeLightbar(&lightbar);
+}
+
+int main()
+{
+    fake::quiet = true;
+    RUN(testPressIsCleared);
+    RUN(testStepsAreAggregated);
+    RUN(testFramesWithSeveralSteps);
+    RUN(testTurnsAreSeparated);
+    RUN(testTopicSerialParsing);
+    return test::report("test_mqtt");
+}
@@ -0,0 +1,253 @@
+#include "frames.h"
+#include "test.h"
+
+#include "lightbar.h"
+#include "radio.h"
+#include "registry.h"
+#include "remote.h"
+
+static const uint32_t REMOTE_SERIAL = 0xABCDEF;
+
+struct Received
+{
+    int count = 0;
+    byte command = 0;
+    byte options = 0;
+};
+
+static void onCommand(void *context, Remote *remote, byte command, byte options)
+{
+    Received *received = (Received *)context;
+    received->count++;
+    received->command = command;
+    received->options = options;
+}
+
+struct Fixture
+{
+    Registry registry;
+    Radio radio;
+    Remote remote;
+    Received received;
+
+    Fixture() : radio(&registry, 1, 2), remote(&radio, REMOTE_SERIAL, "Remote")
+    {
+        fake::nrf24.reset();
+        this->radio.setup();
+        this->remote.registerCommandListener(onCommand, &this->received);
+    }
+};
+
+enum Verdict
+{
+    PREAMBLE_REJECT,
+    CHECKSUM_FAILURE,
+    UNKNOWN_SERIAL,
+    DUPLICATE,
+    ACCEPTED,
+    NOT_HANDLED
+};
+
+// How packages were decoded before the raw pre-filter: put the lost 5 back and realign all bytes
+// bit by bit, then check preamble, checksum and serial.
+static Verdict referenceVerdict(const byte *raw, byte *data)
+{
+    for (int i = 0; i < 17; i++)
+    {
+        if (i == 0)
+            data[i] = 0x50 | raw[i] >> 5;
+        else
+            data[i] = ((raw[i - 1] >> 1) & 0x0F) << 4 | ((raw[i - 1] & 0x01) << 3) | raw[i] >> 5;
+    }
+    if (memcmp(data, frames::PREAMBLE, sizeof(frames::PREAMBLE)))
+        return PREAMBLE_REJECT;
+    if (frames::crc16(data, 15) != (data[15] << 8 | data[16]))
+        return CHECKSUM_FAILURE;
+    if ((uint32_t)(data[8] << 16 | data[9] << 8 | data[10]) != REMOTE_SERIAL)
+        return UNKNOWN_SERIAL;
+    return ACCEPTED;
+}
+
+// Lets the radio receive and handle a single package and tells from its counters what it did with it.
+static Verdict receive(Fixture *fixture, const byte *raw)
+{
+    RadioStats before = fixture->radio.getStats();
+    fake::nrf24.receive(raw, 18);
+    fixture->radio.loop();
+    const RadioStats &after = fixture->radio.getStats();
+    if (after.preamble_rejects != before.preamble_rejects)
+        return PREAMBLE_REJECT;
+    if (after.checksum_failures != before.checksum_failures)
+        return CHECKSUM_FAILURE;
+    if (after.unknown_serials != before.unknown_serials)
+        return UNKNOWN_SERIAL;
+    if (after.duplicates != before.duplicates)
+        return DUPLICATE;
+    if (after.packages_accepted != before.packages_accepted)
+        return ACCEPTED;
+    return NOT_HANDLED;
+}
+
+static void testValidPackagesAreDecoded()
+{
+    Fixture fixture;
+    srand(1);
+    for (int i = 0; i < 1000; i++)
+    {
+        byte command = rand();
+        byte options = rand();
+        byte raw[18];
+        frames::raw(raw, REMOTE_SERIAL, i, command, options);
+
+        int count = fixture.received.count;
+        CHECK_EQUAL(ACCEPTED, receive(&fixture, raw));
+        CHECK_EQUAL(count + 1, fixture.received.count);
+        CHECK_EQUAL(command, fixture.received.command);
+        CHECK_EQUAL(options, fixture.received.options);
+    }
+}
+
+// Every bit of a valid package is flipped once. Whatever the reference decoder makes of the result,
+// the pre-filter and the realignment have to come to the same conclusion.
+static void testCorruptedPackagesMatchReference()
+{
+    Fixture fixture;
+    SerialEntry *entry = fixture.registry.find(REMOTE_SERIAL);
+    byte valid[18];
+    frames::raw(valid, REMOTE_SERIAL, 0x42, 0x04, 0x00);
+    for (int bit = 0; bit < 18 * 8; bit++)
+    {
+        byte raw[18];
+        memcpy(raw, valid, sizeof(raw));
+        raw[bit / 8] ^= 0x80 >> (bit % 8);
+
+        byte data[17];
+        entry->packages.reset();
+        if (!CHECK_EQUAL(referenceVerdict(raw, data), receive(&fixture, raw)))
+            fprintf(stderr, "    with bit %d flipped\n", bit);
+    }
+}
+
+static void testNoiseMatchesReference()
+{
+    Fixture fixture;
+    SerialEntry *entry = fixture.registry.find(REMOTE_SERIAL);
+    srand(2);
+    int rejected = 0;
+    for (int i = 0; i < 100000; i++)
+    {
+        byte raw[18];
+        for (size_t j = 0; j < sizeof(raw); j++)
+            raw[j] = rand();
+
+        // Also produce packages that only differ from the preamble in their later bytes.
+        byte valid[18];
+        frames::raw(valid, REMOTE_SERIAL, rand(), rand(), rand());
+        memcpy(raw, valid, i % 9);
+
+        byte data[17];
+        entry->packages.reset();
+        Verdict expected = referenceVerdict(raw, data);
+        if (expected == PREAMBLE_REJECT)
+            rejected++;
+        CHECK_EQUAL(expected, receive(&fixture, raw));
+    }
+    CHECK(rejected > 0);
+    CHECK_EQUAL(rejected, fixture.radio.getStats().preamble_rejects);
+}
+
+static void testRejectionStages()
+{
+    Fixture fixture;
+    byte raw[18];
+
+    memset(raw, 0x55, sizeof(raw));
+    CHECK_EQUAL(PREAMBLE_REJECT, receive(&fixture, raw));
+
+    byte frame[17];
+    frames::build(frame, REMOTE_SERIAL, 1, 0x01, 0x00);
+    frame[16] ^= 0x01;
+    frames::shift(frame, raw);
+    CHECK_EQUAL(CHECKSUM_FAILURE, receive(&fixture, raw));
+
+    frames::raw(raw, 0x123456, 1, 0x01, 0x00);
+    CHECK_EQUAL(UNKNOWN_SERIAL, receive(&fixture, raw));
+
+    frames::raw(raw, REMOTE_SERIAL, 1, 0x01, 0x00);
+    CHECK_EQUAL(ACCEPTED, receive(&fixture, raw));
+    CHECK_EQUAL(DUPLICATE, receive(&fixture, raw));
+
+    const RadioStats &stats = fixture.radio.getStats();
+    CHECK_EQUAL(5, stats.packages_received);
+    CHECK_EQUAL(1, stats.preamble_rejects);
+    CHECK_EQUAL(1, stats.checksum_failures);
+    CHECK_EQUAL(1, stats.unknown_serials);
+    CHECK_EQUAL(1, stats.duplicates);
+    CHECK_EQUAL(1, stats.packages_accepted);
+}
+
+// A light bar sharing its serial with a remote drops frames whose sequence counter is not ahead of the
+// remote's, so the controller has to continue from there.
+static void testSharedSerialContinuesSequence()
+{
+    Fixture fixture;
+    Lightbar lightbar(&fixture.radio, REMOTE_SERIAL, "Light bar");
+
+    byte raw[18];
+    frames::raw(raw, REMOTE_SERIAL, 200, Lightbar::Command::BRIGHTER, 0x00);
+    CHECK_EQUAL(ACCEPTED, receive(&fixture, raw));
+
+    lightbar.sendRawCommand(Lightbar::Command::ON_OFF);
+    for (int i = 0; i < 100 && fake::nrf24.tx.empty(); i++)
+        fixture.radio.loop();
+    CHECK(!fake::nrf24.tx.empty());
+    if (!fake::nrf24.tx.empty())
+    {
+        byte frame[17];
+        frames::build(frame, REMOTE_SERIAL, 201, Lightbar::Command::ON_OFF, 0x00);
+        CHECK(memcmp(frame, fake::nrf24.tx[0].data, sizeof(frame)) == 0);
+    }
+}
+
+// The interrupt handler only notes that a package arrived. Reading it needs SPI, which must not run
+// from the handler, so that is left to loop().
+static void testInterruptOnlyFlagsPackages()
+{
+    const uint8_t IRQ_PIN = 5;
+    fake::nrf24.reset();
+    Registry registry;
+    Radio radio(&registry, 1, 2, IRQ_PIN);
+    Remote remote(&radio, REMOTE_SERIAL, "Remote");
+    Received received;
+    remote.registerCommandListener(onCommand, &received);
+    radio.setup();
+
+    byte raw[18];
+    frames::raw(raw, REMOTE_SERIAL, 1, 0x01, 0x00);
+    fake::nrf24.receive(raw, sizeof(raw));
+
+    // Without an interrupt, loop() does not talk to the nRF24.
+    radio.loop();
+    CHECK_EQUAL(1, fake::nrf24.rx.size());
+    CHECK_EQUAL(0, received.count);
+
+    fake::interrupt(IRQ_PIN);
+    CHECK_EQUAL(1, fake::nrf24.rx.size());
+    CHECK_EQUAL(0, received.count);
+
+    radio.loop();
+    CHECK_EQUAL(0, fake::nrf24.rx.size());
+    CHECK_EQUAL(1, received.count);
+}
+
+int main()
+{
+    fake::quiet = true;
+    RUN(testValidPackagesAreDecoded);
+    RUN(testCorruptedPackagesMatchReference);
+    RUN(testNoiseMatchesReference);
+    RUN(testRejectionStages);
+    RUN(testSharedSerialContinuesSequence);
+    RUN(testInterruptOnlyFlagsPackages);
+    return test::report("test_radio");
+}
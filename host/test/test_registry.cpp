@@ -0,0 +1,166 @@
+#include "controller.h"
+#include "frames.h"
+#include "test.h"
+
+#include "registry.h"
+
+static void testRepeatsAreDropped()
+{
+    ReplayWindow window;
+    CHECK(window.accept(10));
+    for (int i = 0; i < 20; i++)
+        CHECK(!window.accept(10));
+    CHECK(window.accept(11));
+    CHECK(!window.accept(11));
+}
+
+static void testWrapsAround()
+{
+    ReplayWindow window;
+    CHECK(window.accept(254));
+    CHECK(window.accept(255));
+    CHECK(window.accept(0));
+    CHECK(window.accept(1));
+
+    // Repeats from before the wrap are still known.
+    CHECK(!window.accept(254));
+    CHECK(!window.accept(255));
+    CHECK(!window.accept(0));
+    CHECK(!window.accept(1));
+
+    // A full cycle through all ids, one at a time.
+    for (int i = 2; i < 2 + 3 * 256; i++)
+    {
+        CHECK(window.accept(i));
+        CHECK(!window.accept(i));
+        CHECK(!window.accept(i - 1));
+    }
+}
+
+static void testLateRepeatsAreDropped()
+{
+    ReplayWindow window;
+    CHECK(window.accept(100));
+    CHECK(window.accept(102));
+    CHECK(window.accept(105));
+
+    // Packages that were missed are accepted once, even after newer ones.
+    CHECK(window.accept(101));
+    CHECK(window.accept(104));
+    CHECK(!window.accept(101));
+    CHECK(!window.accept(104));
+
+    // Out-of-order repeats of everything seen so far.
+    for (uint8_t id : {100, 105, 102, 101, 104, 100})
+        CHECK(!window.accept(id));
+    CHECK(window.accept(103));
+}
+
+static void testOldestIdInWindow()
+{
+    ReplayWindow window;
+    CHECK(window.accept(0));
+    CHECK(window.accept(ReplayWindow::WINDOW - 1));
+
+    // 0 is exactly at the edge of the window and still remembered.
+    CHECK(!window.accept(0));
+    CHECK(window.accept(ReplayWindow::WINDOW));
+
+    // Now it fell out of the window. It is treated as a restarted remote.
+    CHECK(window.accept(0));
+    CHECK(!window.accept(0));
+}
+
+static void testJumpAheadClearsWindow()
+{
+    ReplayWindow window;
+    CHECK(window.accept(10));
+    CHECK(window.accept(10 + ReplayWindow::WINDOW + 5));
+    CHECK(!window.accept(10 + ReplayWindow::WINDOW + 5));
+    CHECK(window.accept(10 + ReplayWindow::WINDOW + 4));
+}
+
+static void testReset()
+{
+    ReplayWindow window;
+    CHECK(window.accept(7));
+    CHECK(!window.accept(7));
+    window.reset();
+    CHECK(window.accept(7));
+    CHECK(!window.accept(7));
+
+    // After a reset, any id is a valid start, including ones behind the previous latest.
+    window.reset();
+    CHECK(window.accept(3));
+    CHECK(window.accept(4));
+}
+
+static void countCommand(void *context, Remote *remote, byte command, byte options)
+{
+    (*(int *)context)++;
+}
+
+static void testListenersCanBeUnregistered()
+{
+    fake::resetAll();
+    Controller controller(0, 1);
+    Remote *remote = controller.remotes[0];
+    int first = 0;
+    int second = 0;
+    int8_t firstHandle = remote->registerCommandListener(countCommand, &first);
+    int8_t secondHandle = remote->registerCommandListener(countCommand, &second);
+    CHECK(firstHandle != Remote::NO_LISTENER);
+    CHECK(secondHandle != Remote::NO_LISTENER);
+    CHECK(firstHandle != secondHandle);
+
+    remote->callback(Lightbar::Command::ON_OFF, 0);
+    CHECK(remote->unregisterCommandListener(firstHandle));
+    CHECK(!remote->unregisterCommandListener(firstHandle));
+    remote->callback(Lightbar::Command::ON_OFF, 0);
+    CHECK_EQUAL(1, first);
+    CHECK_EQUAL(2, second);
+}
+
+// A light bar keeps the registry entry of its serial alive when the remote sharing it is removed. A
+// remote added for the serial later must not inherit anything from the old one.
+static void testReaddedRemoteGetsListener()
+{
+    const uint32_t SERIAL = 0x654321;
+    fake::resetAll();
+    Controller controller(0, 0);
+    controller.loop();
+    Lightbar lightbar(&controller.radio, SERIAL, "Light bar");
+    Remote *old = new Remote(&controller.radio, SERIAL, "Old remote");
+    CHECK(controller.mqtt.addRemote(old));
+    CHECK(controller.radio.removeRemote(old));
+    delete old;
+
+    Remote remote(&controller.radio, SERIAL, "Remote");
+    CHECK(controller.mqtt.addRemote(&remote));
+    CHECK(controller.registry.find(SERIAL)->actionTopic.length() > 0);
+
+    byte raw[18];
+    frames::raw(raw, SERIAL, 1, Lightbar::Command::ON_OFF, 0x00);
+    fake::nrf24.receive(raw, sizeof(raw));
+    controller.loop();
+    const fake::Message *state = fake::broker.last(controller.topic(SERIAL, "state").c_str());
+    CHECK(state != nullptr && state->payload == "press");
+
+    controller.mqtt.removeRemote(&remote);
+    controller.radio.removeRemote(&remote);
+    controller.radio.removeLightbar(&lightbar);
+}
+
+int main()
+{
+    fake::quiet = true;
+    RUN(testRepeatsAreDropped);
+    RUN(testWrapsAround);
+    RUN(testLateRepeatsAreDropped);
+    RUN(testOldestIdInWindow);
+    RUN(testJumpAheadClearsWindow);
+    RUN(testReset);
+    RUN(testListenersCanBeUnregistered);
+    RUN(testReaddedRemoteGetsListener);
+    return test::report("test_registry");
+}
@@ -0,0 +1,103 @@
+#include "test.h"
+
+#include "scheduler.h"
+
+#include <vector>
+
+static std::vector<uint32_t> ran;
+
+static void record(void *context, uint32_t key)
+{
+    ran.push_back(key);
+}
+
+static void reschedule(void *context, uint32_t key)
+{
+    ran.push_back(key);
+    ((Scheduler *)context)->schedule(10, reschedule, context, key);
+}
+
+// Runs the scheduler's loop every millisecond for the given time.
+static void run(Scheduler *scheduler, unsigned long ms)
+{
+    for (unsigned long i = 0; i < ms; i++)
+    {
+        fake::advance(1000);
+        scheduler->loop();
+    }
+}
+
+static void testTasksRunOnceWhenDue()
+{
+    Scheduler scheduler;
+    ran.clear();
+    CHECK(scheduler.schedule(20, record, nullptr, 1));
+    CHECK(scheduler.schedule(10, record, nullptr, 2));
+    run(&scheduler, 9);
+    CHECK_EQUAL(0, ran.size());
+    run(&scheduler, 1);
+    CHECK(ran == std::vector<uint32_t>({2}));
+    run(&scheduler, 100);
+    CHECK(ran == std::vector<uint32_t>({2, 1}));
+}
+
+// Scheduling a task again moves it, so it still runs once.
+static void testSchedulingAgainMovesTheTask()
+{
+    Scheduler scheduler;
+    ran.clear();
+    scheduler.schedule(10, record, nullptr, 1);
+    run(&scheduler, 8);
+    scheduler.schedule(10, record, nullptr, 1);
+    run(&scheduler, 8);
+    CHECK_EQUAL(0, ran.size());
+    run(&scheduler, 2);
+    CHECK_EQUAL(1, ran.size());
+    run(&scheduler, 100);
+    CHECK_EQUAL(1, ran.size());
+}
+
+static void testCancel()
+{
+    Scheduler scheduler;
+    ran.clear();
+    scheduler.schedule(10, record, nullptr, 1);
+    scheduler.schedule(10, record, nullptr, 2);
+    CHECK(scheduler.cancel(record, nullptr, 1));
+    CHECK(!scheduler.cancel(record, nullptr, 1));
+    run(&scheduler, 100);
+    CHECK(ran == std::vector<uint32_t>({2}));
+}
+
+static void testTaskCanScheduleItself()
+{
+    Scheduler scheduler;
+    ran.clear();
+    scheduler.schedule(10, reschedule, &scheduler, 7);
+    run(&scheduler, 55);
+    CHECK_EQUAL(5, ran.size());
+    CHECK(scheduler.cancel(reschedule, &scheduler, 7));
+}
+
+static void testFullScheduler()
+{
+    Scheduler scheduler;
+    ran.clear();
+    for (uint32_t i = 0; i < constants::MAX_SCHEDULED_TASKS; i++)
+        CHECK(scheduler.schedule(10, record, nullptr, i));
+    CHECK(!scheduler.schedule(10, record, nullptr, constants::MAX_SCHEDULED_TASKS));
+    CHECK(scheduler.schedule(20, record, nullptr, 0));
+    run(&scheduler, 100);
+    CHECK_EQUAL(constants::MAX_SCHEDULED_TASKS, ran.size());
+}
+
+int main()
+{
+    fake::quiet = true;
+    RUN(testTasksRunOnceWhenDue);
+    RUN(testSchedulingAgainMovesTheTask);
+    RUN(testCancel);
+    RUN(testTaskCanScheduleItself);
+    RUN(testFullScheduler);
+    return test::report("test_scheduler");
+}
@@ -7,6 +7,9 @@ Lightbar::Lightbar(Radio *radio, uint32_t serial, const char *name)
     this->name = name;
 
     this->serialString = "0x" + String(this->serial, HEX);
+    Radio::prepareFrameTemplate(&this->frame, this->serial);
+
+    this->radio->addLightbar(this);
 }
 
 Lightbar::~Lightbar()
@@ -18,7 +21,7 @@ uint32_t Lightbar::getSerial()
     return this->serial;
 }
 
-const String Lightbar::getSerialString()
+const String &Lightbar::getSerialString()
 {
     return this->serialString;
 }
@@ -28,65 +31,75 @@ const char *Lightbar::getName()
     return this->name;
 }
 
+FrameTemplate *Lightbar::getFrameTemplate()
+{
+    return &this->frame;
+}
+
 void Lightbar::sendRawCommand(Command command, byte options)
 {
-    this->radio->sendCommand(serial, command, options);
+    this->radio->sendCommand(&this->frame, command, options);
 }
 
 void Lightbar::sendRawCommand(Command command)
 {
-    this->radio->sendCommand(serial, command);
+    this->radio->sendCommand(&this->frame, command, 0x0);
 }
 
 void Lightbar::onOff()
 {
-    this->sendRawCommand(Lightbar::Command::ON_OFF);
-    onState = !onState;
+    // Two toggles in a row cancel each other out before anything is sent.
+    this->pendingOnState = !this->pendingOnState;
+    this->updateRequestTime();
 }
 
 void Lightbar::setOnOff(bool on)
 {
-    if (onState != on)
-        this->onOff();
+    this->pendingOnState = on;
+    this->updateRequestTime();
 }
 
 void Lightbar::brighter()
 {
     this->sendRawCommand(Lightbar::Command::BRIGHTER);
+    this->invalidateState();
 }
 
 void Lightbar::dimmer()
 {
     this->sendRawCommand(Lightbar::Command::DIMMER);
+    this->invalidateState();
 }
 
 void Lightbar::warmer()
 {
     this->sendRawCommand(Lightbar::Command::WARMER);
+    this->invalidateState();
 }
 
 void Lightbar::cooler()
 {
     this->sendRawCommand(Lightbar::Command::COOLER);
+    this->invalidateState();
 }
 
 void Lightbar::reset()
 {
     this->sendRawCommand(Lightbar::Command::RESET);
+    this->invalidateState();
 }
 
 void Lightbar::pair()
 {
-    this->sendRawCommand(Lightbar::Command::RESET);
+    this->pendingPair = true;
+    this->updateRequestTime();
 }
 
 void Lightbar::setTemperature(uint8_t value)
 {
-    // Send max value first, then set to the desired value. See
-    // https://github.com/lamperez/xiaomi-lightbar-nrf24?tab=readme-ov-file#command-codes
-    // for details.
-    this->sendRawCommand(Lightbar::Command::COOLER, 0x0 - 16);
-    this->sendRawCommand(Lightbar::Command::WARMER, (byte)value);
+    this->pendingTemperature = min(value, constants::LIGHTBAR_STEPS);
+    this->hasPendingTemperature = true;
+    this->updateRequestTime();
 }
 
 void Lightbar::setMiredTemperature(uint mireds)
@@ -99,9 +112,106 @@ void Lightbar::setMiredTemperature(uint mireds)
 
 void Lightbar::setBrightness(uint8_t value)
 {
-    // Send max value first, then set to the desired value. See
-    // https://github.com/lamperez/xiaomi-lightbar-nrf24?tab=readme-ov-file#command-codes
-    // for details.
-    this->sendRawCommand(Lightbar::Command::DIMMER, 0x0 - 16);
-    this->sendRawCommand(Lightbar::Command::BRIGHTER, (byte)value);
+    this->pendingBrightness = min(value, constants::LIGHTBAR_STEPS);
+    this->hasPendingBrightness = true;
+    this->updateRequestTime();
+}
+
+bool Lightbar::hasPendingCommands()
+{
+    return this->pendingPair || this->pendingOnState != this->onState || this->hasPendingBrightness || this->hasPendingTemperature;
+}
+
+void Lightbar::flushPendingCommands()
+{
+    if (this->pendingPair)
+    {
+        this->sendRawCommand(Lightbar::Command::RESET);
+        this->pendingPair = false;
+    }
+
+    if (this->pendingOnState != this->onState)
+    {
+        this->sendRawCommand(Lightbar::Command::ON_OFF);
+        this->onState = this->pendingOnState;
+    }
+
+    // Each value is only trusted for a while after it was last sent as an absolute value.
+    if (millis() - this->brightnessAnchor > constants::LIGHTBAR_RESYNC_INTERVAL)
+        this->brightnessKnown = false;
+    if (millis() - this->temperatureAnchor > constants::LIGHTBAR_RESYNC_INTERVAL)
+        this->temperatureKnown = false;
+
+    if (this->hasPendingBrightness)
+    {
+        this->sendBrightness(this->pendingBrightness);
+        this->hasPendingBrightness = false;
+    }
+
+    if (this->hasPendingTemperature)
+    {
+        this->sendTemperature(this->pendingTemperature);
+        this->hasPendingTemperature = false;
+    }
+    this->frame.requested_at = 0;
+}
+
+// Remembers when the oldest pending command was requested, so the radio can measure how long it
+// took until its first frame went on air. The time is made odd, as zero means nothing is pending,
+// by going back a microsecond rather than ahead, which a frame sent right away would come before.
+void Lightbar::updateRequestTime()
+{
+    if (!this->hasPendingCommands())
+        this->frame.requested_at = 0;
+    else if (this->frame.requested_at == 0)
+        this->frame.requested_at = (micros() - 1) | 1;
+}
+
+void Lightbar::invalidateState()
+{
+    this->brightnessKnown = false;
+    this->temperatureKnown = false;
+}
+
+void Lightbar::sendBrightness(uint8_t value)
+{
+    // Steps are counted like in the absolute case below: up as a positive, down as a negative
+    // two's complement number.
+    if (this->brightnessKnown)
+    {
+        if (value > this->brightness)
+            this->sendRawCommand(Lightbar::Command::BRIGHTER, (byte)(value - this->brightness));
+        else if (value < this->brightness)
+            this->sendRawCommand(Lightbar::Command::DIMMER, (byte)(value - this->brightness));
+    }
+    else
+    {
+        // Send max value first, then set to the desired value. See
+        // https://github.com/lamperez/xiaomi-lightbar-nrf24?tab=readme-ov-file#command-codes
+        // for details.
+        this->sendRawCommand(Lightbar::Command::DIMMER, 0x0 - 16);
+        this->sendRawCommand(Lightbar::Command::BRIGHTER, value);
+        this->brightnessKnown = true;
+        this->brightnessAnchor = millis();
+    }
+    this->brightness = value;
+}
+
+void Lightbar::sendTemperature(uint8_t value)
+{
+    if (this->temperatureKnown)
+    {
+        if (value > this->temperature)
+            this->sendRawCommand(Lightbar::Command::WARMER, (byte)(value - this->temperature));
+        else if (value < this->temperature)
+            this->sendRawCommand(Lightbar::Command::COOLER, (byte)(value - this->temperature));
+    }
+    else
+    {
+        this->sendRawCommand(Lightbar::Command::COOLER, 0x0 - 16);
+        this->sendRawCommand(Lightbar::Command::WARMER, value);
+        this->temperatureKnown = true;
+        this->temperatureAnchor = millis();
+    }
+    this->temperature = value;
 }
\ No newline at end of file
@@ -9,8 +9,9 @@ public:
     Lightbar(Radio *radio, uint32_t serial, const char *name);
     ~Lightbar();
     uint32_t getSerial();
-    const String getSerialString();
+    const String &getSerialString();
     const char *getName();
+    FrameTemplate *getFrameTemplate();
 
     enum Command
     {
@@ -36,9 +37,38 @@ public:
     void setMiredTemperature(uint mireds);
     void setBrightness(uint8_t value);
 
+    bool hasPendingCommands();
+    void flushPendingCommands();
+    void invalidateState();
+
 private:
     Radio *radio;
-    bool onState = false;
+    FrameTemplate frame;
+    // The light bar is assumed to be on after the controller started.
+    bool onState = true;
+
+    // Target state requested via the set*() methods and pair(). It is only turned into frames
+    // once the radio is ready to send them, so newer values replace older ones.
+    bool pendingOnState = true;
+    bool pendingPair = false;
+    bool hasPendingBrightness = false;
+    uint8_t pendingBrightness = 0;
+    bool hasPendingTemperature = false;
+    uint8_t pendingTemperature = 0;
+
+    // Brightness and color temperature the light bar is believed to have. While a value is known,
+    // changes are sent as a single relative step frame instead of a max/min frame plus a relative one.
+    bool brightnessKnown = false;
+    uint8_t brightness = 0;
+    bool temperatureKnown = false;
+    uint8_t temperature = 0;
+    // When each value was last sent as an absolute value, see constants::LIGHTBAR_RESYNC_INTERVAL.
+    unsigned long brightnessAnchor = 0;
+    unsigned long temperatureAnchor = 0;
+
+    void updateRequestTime();
+    void sendBrightness(uint8_t value);
+    void sendTemperature(uint8_t value);
     uint32_t serial;
     String serialString;
     const char *name;
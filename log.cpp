@@ -0,0 +1,77 @@
+#include "log.h"
+
+static_assert((constants::LOG_BUFFER_SIZE & (constants::LOG_BUFFER_SIZE - 1)) == 0,
+              "LOG_BUFFER_SIZE must be a power of two");
+
+namespace logger
+{
+    static char buffer[constants::LOG_BUFFER_SIZE];
+    static uint16_t bufferWrite = 0;
+    static uint16_t bufferRead = 0;
+    static uint32_t dropped = 0;
+
+    static bool push(const char *line, uint16_t length)
+    {
+        if (constants::LOG_BUFFER_SIZE - (uint16_t)(bufferWrite - bufferRead) < length)
+            return false;
+        for (uint16_t i = 0; i < length; i++)
+            buffer[(bufferWrite + i) & (constants::LOG_BUFFER_SIZE - 1)] = line[i];
+        bufferWrite += length;
+        return true;
+    }
+
+    void write(PGM_P format, ...)
+    {
+        char line[constants::LOG_LINE_LENGTH];
+        va_list args;
+        va_start(args, format);
+        int length = vsnprintf_P(line, sizeof(line), format, args);
+        va_end(args);
+        if (length < 0)
+            return;
+
+        // Keep the line break of lines that were cut off.
+        if (length >= (int)sizeof(line))
+        {
+            length = sizeof(line) - 1;
+            line[length - 1] = '\n';
+        }
+
+        // Rather lose messages than wait for the UART.
+        if (!push(line, length))
+            dropped++;
+    }
+
+    void loop()
+    {
+        if (dropped > 0)
+        {
+            char line[48];
+            int length = snprintf(line, sizeof(line), "[Log] %u messages dropped!\n", dropped);
+            if (push(line, length))
+                dropped = 0;
+        }
+
+        int space = Serial.availableForWrite();
+        while (space > 0 && bufferRead != bufferWrite)
+        {
+            // Write up to the end of the buffer at once, the rest follows in the next iteration.
+            uint16_t start = bufferRead & (constants::LOG_BUFFER_SIZE - 1);
+            uint16_t length = min((uint16_t)(bufferWrite - bufferRead), (uint16_t)(constants::LOG_BUFFER_SIZE - start));
+            length = min(length, (uint16_t)space);
+            Serial.write(buffer + start, length);
+            bufferRead += length;
+            space -= length;
+        }
+    }
+
+    void flush()
+    {
+        while (bufferRead != bufferWrite || dropped > 0)
+        {
+            loop();
+            yield();
+        }
+        Serial.flush();
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <Arduino.h>
+
+#include "constants.h"
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARNING 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+// The most detailed level logged by each module. Messages above it are not compiled in at all.
+// They can be changed here or with build flags, e.g. -DLOG_LEVEL_RADIO=LOG_LEVEL_DEBUG.
+#ifndef LOG_LEVEL_RADIO
+#define LOG_LEVEL_RADIO LOG_LEVEL_INFO
+#endif
+#ifndef LOG_LEVEL_MQTT
+#define LOG_LEVEL_MQTT LOG_LEVEL_INFO
+#endif
+#ifndef LOG_LEVEL_REMOTE
+#define LOG_LEVEL_REMOTE LOG_LEVEL_INFO
+#endif
+#ifndef LOG_LEVEL_WIFI
+#define LOG_LEVEL_WIFI LOG_LEVEL_INFO
+#endif
+#ifndef LOG_LEVEL_REGISTRY
+#define LOG_LEVEL_REGISTRY LOG_LEVEL_INFO
+#endif
+#ifndef LOG_LEVEL_SCHEDULER
+#define LOG_LEVEL_SCHEDULER LOG_LEVEL_INFO
+#endif
+#ifndef LOG_LEVEL_DISCOVERY_CACHE
+#define LOG_LEVEL_DISCOVERY_CACHE LOG_LEVEL_INFO
+#endif
+
+#define LOG_NAME_RADIO "Radio"
+#define LOG_NAME_MQTT "MQTT"
+#define LOG_NAME_REMOTE "Remote"
+#define LOG_NAME_WIFI "WiFi"
+#define LOG_NAME_REGISTRY "Registry"
+#define LOG_NAME_SCHEDULER "Scheduler"
+#define LOG_NAME_DISCOVERY_CACHE "DiscoveryCache"
+
+#define LOG_ENABLED(module, level) (LOG_LEVEL_##module >= LOG_LEVEL_##level)
+
+// Logs a printf-style message, e.g. LOG(RADIO, DEBUG, "Queueing command: 0x%s", hex). The format
+// string is kept in flash. If the level is disabled for the module, the condition is known at compile
+// time and the whole statement is removed.
+#define LOG(module, level, format, ...)                                                      \
+    do                                                                                       \
+    {                                                                                        \
+        if (LOG_ENABLED(module, level))                                                      \
+            logger::write(PSTR("[" LOG_NAME_##module "] " format "\n"), ##__VA_ARGS__);      \
+    } while (0)
+
+// Log messages are formatted into a ring buffer in RAM and written to the serial port from loop(),
+// only as fast as the UART accepts them. Writing them directly would block the caller at 115200 baud.
+namespace logger
+{
+    void write(PGM_P format, ...) __attribute__((format(printf, 1, 2)));
+    void loop();
+    void flush();
+}
+
+#endif
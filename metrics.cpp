@@ -0,0 +1,91 @@
+#include "metrics.h"
+#include "log.h"
+
+Metrics::Metrics(Radio *radio, MQTT *mqtt, WiFiConnection *wifi)
+{
+    this->radio = radio;
+    this->mqtt = mqtt;
+    this->wifi = wifi;
+}
+
+Metrics::~Metrics()
+{
+}
+
+void Metrics::setup()
+{
+    this->topic = this->mqtt->getCombinedRootTopic() + "/diagnostics";
+    this->lastLoop = micros();
+}
+
+void Metrics::loop()
+{
+    unsigned long now = micros();
+    this->loopTime.add(now - this->lastLoop);
+    this->lastLoop = now;
+
+    if (!this->mqtt->isConnected() || millis() - this->lastPublish < constants::METRICS_INTERVAL)
+        return;
+    this->lastPublish = millis();
+    this->publish();
+
+    // Publishing takes a while itself, which should not count as loop time.
+    this->lastLoop = micros();
+}
+
+void Metrics::publish()
+{
+    const RadioStats &radio = this->radio->getStats();
+    const MQTTStats &mqtt = this->mqtt->getStats();
+
+    this->length = 0;
+    this->append("{\"uptime\":%lu", millis() / 1000);
+    this->append(",\"rx\":{\"packages\":%u,\"preamble_rejects\":%u,\"checksum_failures\":%u,\"unknown_serials\":%u,\"duplicates\":%u,\"accepted\":%u",
+                 radio.packages_received, radio.preamble_rejects, radio.checksum_failures, radio.unknown_serials, radio.duplicates, radio.packages_accepted);
+    this->append(",\"buffer_length\":%u,\"buffer_high_water_mark\":%u,\"buffer_overflows\":%u}",
+                 this->radio->getReceiveBufferLength(), radio.buffer_high_water_mark, radio.buffer_overflows);
+    this->append(",\"tx\":{\"frames_queued\":%u,\"frames_sent\":%u,\"transmissions\":%u,\"queue_length\":%u,\"queue_high_water_mark\":%u,\"queue_full\":%u}",
+                 radio.frames_queued, radio.frames_sent, radio.transmissions, this->radio->getTransmitQueueLength(), radio.queue_high_water_mark, radio.queue_full);
+    this->append(",\"mqtt\":{\"publishes\":%u,\"publish_failures\":%u,\"connects\":%u,\"connect_failures\":%u}",
+                 mqtt.publishes, mqtt.publish_failures, mqtt.connects, mqtt.connect_failures);
+    this->append(",\"wifi\":{\"connects\":%u,\"rssi\":%d}", this->wifi->getConnectCount(), (int)WiFi.RSSI());
+    this->append(",\"heap\":{\"free\":%u,\"max_free_block\":%u}", ESP.getFreeHeap(), ESP.getMaxFreeBlockSize());
+    this->appendHistogram("loop_time", this->loopTime);
+    this->appendHistogram("command_latency", radio.command_latency);
+    this->appendHistogram("action_latency", radio.action_latency);
+    this->append("}");
+
+    if (this->length >= sizeof(this->payload))
+    {
+        LOG(MQTT, ERROR, "Diagnostics do not fit into METRICS_PAYLOAD_SIZE!");
+        return;
+    }
+    this->mqtt->publish(this->topic.c_str(), (const byte *)this->payload, this->length, true);
+
+    this->loopTime.reset();
+    this->radio->resetHistograms();
+}
+
+void Metrics::append(const char *format, ...)
+{
+    if (this->length >= sizeof(this->payload))
+        return;
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(this->payload + this->length, sizeof(this->payload) - this->length, format, args);
+    va_end(args);
+    this->length += written > 0 ? written : 0;
+}
+
+void Metrics::appendHistogram(const char *name, const Histogram &histogram)
+{
+    // Trailing empty buckets are left out.
+    uint8_t used = Histogram::BUCKETS;
+    while (used > 0 && histogram.buckets[used - 1] == 0)
+        used--;
+
+    this->append(",\"%s\":{\"count\":%u,\"max\":%u,\"buckets\":[", name, histogram.count, histogram.max);
+    for (uint8_t i = 0; i < used; i++)
+        this->append(i == 0 ? "%u" : ",%u", histogram.buckets[i]);
+    this->append("]}");
+}
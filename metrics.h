@@ -0,0 +1,43 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+
+#include "connection.h"
+#include "constants.h"
+#include "histogram.h"
+#include "mqtt.h"
+#include "radio.h"
+
+// Collects the counters of the other modules and the loop timing, and publishes them as retained JSON
+// to <combined root topic>/diagnostics every constants::METRICS_INTERVAL. Histograms cover the time
+// since the previous publish, all counters the time since boot.
+class Metrics
+{
+public:
+    Metrics(Radio *radio, MQTT *mqtt, WiFiConnection *wifi);
+    ~Metrics();
+    void setup();
+    void loop();
+
+private:
+    Radio *radio;
+    MQTT *mqtt;
+    WiFiConnection *wifi;
+    String topic;
+
+    unsigned long lastLoop = 0;
+    unsigned long lastPublish = 0;
+    Histogram loopTime;
+
+    // The JSON document is rendered into this buffer and streamed from there, so publishing needs
+    // no heap and is not limited by the MQTT client's buffer size.
+    char payload[constants::METRICS_PAYLOAD_SIZE];
+    size_t length = 0;
+
+    void publish();
+    void append(const char *format, ...) __attribute__((format(printf, 2, 3)));
+    void appendHistogram(const char *name, const Histogram &histogram);
+};
+
+#endif
@@ -1,9 +1,104 @@
-#include <Arduino_JSON.h>
-
+#include "command.h"
+#include "log.h"
 #include "mqtt.h"
 
-MQTT::MQTT(WiFiClient *wifiClient, const char *mqttServer, int mqttPort, const char *mqttUser, const char *mqttPassword, const char *mqttRootTopic, bool homeAssistantAutoDiscovery, const char *homeAssistantAutoDiscoveryPrefix)
+// The actions a remote can report, in the order their discovery messages are sent.
+static const char *const REMOTE_ACTIONS[] = {
+    "press",
+    "turn_clockwise",
+    "turn_counterclockwise",
+    "press_turn_clockwise",
+    "press_turn_counterclockwise",
+    "hold"};
+
+// The sensors announced for the controller's diagnostics, see Metrics.
+static const struct
+{
+    const char *objectId;
+    PGM_P config;
+} DIAGNOSTICS_SENSORS[] = {
+    {"uptime", discovery::UPTIME_CONFIG},
+    {"free_heap", discovery::FREE_HEAP_CONFIG},
+    {"max_free_block", discovery::MAX_FREE_BLOCK_CONFIG},
+    {"packages_accepted", discovery::PACKAGES_ACCEPTED_CONFIG},
+    {"checksum_failures", discovery::CHECKSUM_FAILURES_CONFIG},
+    {"frames_sent", discovery::FRAMES_SENT_CONFIG},
+    {"loop_time", discovery::LOOP_TIME_CONFIG},
+    {"command_latency", discovery::COMMAND_LATENCY_CONFIG}};
+
+static const char *actionOf(byte command)
 {
+    switch ((uint8_t)command)
+    {
+    case Lightbar::Command::ON_OFF:
+        return "press";
+
+    case Lightbar::Command::BRIGHTER:
+        return "turn_clockwise";
+
+    case Lightbar::Command::DIMMER:
+        return "turn_counterclockwise";
+
+    case Lightbar::Command::WARMER:
+        return "press_turn_counterclockwise";
+
+    case Lightbar::Command::COOLER:
+        return "press_turn_clockwise";
+
+    case Lightbar::Command::RESET:
+        return "hold";
+
+    default:
+        return nullptr;
+    }
+}
+
+// The options of a knob command are the number of steps, counted negative when going down, like the
+// frames a light bar gets from Lightbar. A single step may also come without a count.
+static uint8_t stepsOf(byte options)
+{
+    int8_t steps = (int8_t)options;
+    if (steps == 0)
+        return 1;
+    return steps < 0 ? -steps : steps;
+}
+
+// Parses a serial the way getSerialString() writes it: "0x", then up to six lowercase hex digits without
+// leading zeros. Returns the end of the serial, or nullptr if the text doesn't start with one.
+static const char *parseSerial(const char *text, uint32_t *serial)
+{
+    if (text[0] != '0' || text[1] != 'x')
+        return nullptr;
+    const char *digits = text + 2;
+    uint32_t value = 0;
+    uint8_t length = 0;
+    while (true)
+    {
+        char c = digits[length];
+        uint8_t digit;
+        if (c >= '0' && c <= '9')
+            digit = c - '0';
+        else if (c >= 'a' && c <= 'f')
+            digit = c - 'a' + 10;
+        else
+            break;
+        if (length == 6)
+            return nullptr;
+        value = value << 4 | digit;
+        length++;
+    }
+    if (length == 0 || (digits[0] == '0' && length > 1))
+        return nullptr;
+    *serial = value;
+    return digits + length;
+}
+
+MQTT::MQTT(Registry *registry, Scheduler *scheduler, WiFiClient *wifiClient, const char *mqttServer, int mqttPort, const char *mqttUser, const char *mqttPassword, const char *mqttRootTopic, bool homeAssistantAutoDiscovery, const char *homeAssistantAutoDiscoveryPrefix)
+    : backoff(constants::RECONNECT_INITIAL_DELAY, constants::RECONNECT_MAXIMUM_DELAY)
+{
+    this->registry = registry;
+    this->scheduler = scheduler;
+    this->wifiClient = wifiClient;
     this->mqttServer = mqttServer;
     this->mqttPort = mqttPort;
     this->mqttUser = mqttUser;
@@ -12,8 +107,6 @@ MQTT::MQTT(WiFiClient *wifiClient, const char *mqttServer, int mqttPort, const c
     this->homeAssistantDiscovery = homeAssistantAutoDiscovery;
     this->homeAssistantDiscoveryPrefix = String(homeAssistantAutoDiscoveryPrefix);
 
-    this->remoteCommandHandler = std::bind(&MQTT::sendAction, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3);
-
     this->client = new PubSubClient(*wifiClient);
 
     uint8_t mac[6];
@@ -41,376 +134,446 @@ const String MQTT::getClientId()
 
 void MQTT::onMessage(char *topic, byte *payload, unsigned int length)
 {
-    Serial.print("[MQTT] New Message (");
-    Serial.print(topic);
-    Serial.print("): ");
-    for (int i = 0; i < length; i++)
+    LOG(MQTT, DEBUG, "New Message (%s): %.*s", topic, (int)length, (const char *)payload);
+
+    // Home Assistant announces its (re)start on <discovery prefix>/status. Its retained discovery
+    // configs may be gone then, e.g. if the broker was restarted as well, so publish all of them again.
+    const String &prefix = this->homeAssistantDiscoveryPrefix;
+    if (!strncmp(topic, prefix.c_str(), prefix.length()) && !strcmp(topic + prefix.length(), "/status"))
     {
-        Serial.print((char)payload[i]);
+        if (length == 6 && !strncmp((const char *)payload, "online", length))
+        {
+            this->discoveryRequested = true;
+        }
+        return;
     }
-    Serial.println();
 
-    JSONVar command = JSON.parse(String((char*)payload).substring(0, length));
+    // Topics look like <combined root topic>/0x<serial>/<action>. They are parsed in place and the
+    // light bar is looked up by its serial, so routing needs no allocations.
+    const String &root = this->combinedRootTopic;
+    if (strncmp(topic, root.c_str(), root.length()) || topic[root.length()] != '/')
+        return;
+    const char *serialSegment = topic + root.length() + 1;
+    uint32_t serial;
+    const char *serialEnd = parseSerial(serialSegment, &serial);
+    if (serialEnd == nullptr || *serialEnd != '/')
+        return;
+    const char *action = serialEnd + 1;
+
+    SerialEntry *entry = this->registry->find(serial);
+    if (entry == nullptr || entry->lightbar == nullptr)
+        return;
+    Lightbar *lightbar = entry->lightbar;
 
-    Lightbar *lightbar = nullptr;
-    for (int i = 0; i < this->lightbarCount; i++)
+    if (!strcmp(action, "pair"))
     {
-        lightbar = this->lightbars[i];
-        if (!strcmp(topic, String(this->getCombinedRootTopic() + "/" + lightbar->getSerialString() + "/pair").c_str()))
-        {
-            lightbar->pair();
-            return;
-        }
+        lightbar->pair();
+        return;
+    }
 
-        if (strcmp(topic, String(this->getCombinedRootTopic() + "/" + lightbar->getSerialString() + "/command").c_str()))
-            continue;
+    if (strcmp(action, "command"))
+        return;
 
-        if (JSON.typeof(command) != "object")
-            continue;
+    LightbarCommand command;
+    if (!parseLightbarCommand(payload, length, &command))
+    {
+        LOG(MQTT, WARNING, "Ignoring command that is not a valid JSON object!");
+        return;
+    }
 
-        if (command.hasOwnProperty("state"))
-        {
-            const char *state = command["state"];
-            lightbar->setOnOff(strcmp(state, "ON"));
-        }
+    // The light bar has no transitions, so command.transition is ignored.
+    if (command.hasState)
+    {
+        lightbar->setOnOff(command.state);
+    }
 
-        if (command.hasOwnProperty("brightness"))
-        {
-            lightbar->setBrightness((uint8_t)command["brightness"]);
-        }
+    if (command.hasBrightness)
+    {
+        lightbar->setBrightness(command.brightness);
+    }
 
-        if (command.hasOwnProperty("color_temp"))
-        {
-            lightbar->setMiredTemperature((uint)command["color_temp"]);
-        }
+    if (command.hasColorTemp)
+    {
+        lightbar->setMiredTemperature(command.colorTemp);
     }
 }
 
 void MQTT::setup()
 {
-    Serial.print("[MQTT] Device ID: ");
-    Serial.println(this->clientId);
-    Serial.print("[MQTT] Root Topic: ");
-    Serial.println(this->getCombinedRootTopic());
+    LOG(MQTT, INFO, "Device ID: %s", this->clientId.c_str());
+    LOG(MQTT, INFO, "Root Topic: %s", this->combinedRootTopic.c_str());
 
     this->client->setServer(this->mqttServer, this->mqttPort);
     this->client->setCallback(std::bind(&MQTT::onMessage, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
 
-    uint retries = 0;
-    Serial.println("[MQTT] Connecting to MQTT broker...");
-    while (!this->client->connected())
+    this->client->setSocketTimeout(constants::MQTT_SOCKET_TIMEOUT);
+    this->wifiClient->setTimeout(constants::MQTT_CONNECT_TIMEOUT);
+}
+
+bool MQTT::connect()
+{
+    LOG(MQTT, INFO, "Connecting to MQTT broker...");
+    if (!this->client->connect(this->clientId.c_str(), this->mqttUser, this->mqttPassword, String(this->getCombinedRootTopic() + "/availability").c_str(), 1, true, "offline"))
     {
-        if (!this->client->connect(this->clientId.c_str(), this->mqttUser, this->mqttPassword, String(this->getCombinedRootTopic() + "/availability").c_str(), 1, true, "offline"))
-        {
-            Serial.print("[MQTT] Connection failed! rc=");
-            Serial.print(this->client->state());
-            Serial.println(" trying again in 1 second.");
-            delay(1000);
-            retries++;
-            if (retries > 60)
-                ESP.restart();
-        }
+        this->backoff.failed();
+        this->stats.connect_failures++;
+        LOG(MQTT, WARNING, "Connection failed! rc=%d trying again in %lu ms.", this->client->state(), this->backoff.getDelay());
+        return false;
     }
 
-    Serial.println("[MQTT] connected!");
-    this->client->publish(String(this->getCombinedRootTopic() + "/availability").c_str(), "online", true);
+    LOG(MQTT, INFO, "connected!");
+    this->stats.connects++;
+    this->backoff.reset();
+    return true;
+}
+
+void MQTT::onConnected()
+{
+    this->connected = true;
+    this->publish(String(this->getCombinedRootTopic() + "/availability").c_str(), "online", true);
     this->client->subscribe(String(this->getCombinedRootTopic() + "/+/command").c_str());
     this->client->subscribe(String(this->getCombinedRootTopic() + "/+/pair").c_str());
+    if (this->homeAssistantDiscovery)
+        this->client->subscribe(String(this->homeAssistantDiscoveryPrefix + "/status").c_str());
 
-    this->sendAllHomeAssistantDiscoveryMessages();
+    this->startHomeAssistantDiscovery(false);
 }
 
-bool MQTT::addLightbar(Lightbar *lightbar)
+void MQTT::onDisconnected()
+{
+    // An interrupted discovery job is restarted once connected again.
+    this->connected = false;
+    this->discoveryRunning = false;
+}
+
+bool MQTT::isConnected()
 {
-    if (this->lightbarCount >= constants::MAX_LIGHTBARS)
+    return this->connected;
+}
+
+bool MQTT::publish(const char *topic, const char *payload, bool retained)
+{
+    if (!this->client->publish(topic, payload, retained))
     {
-        Serial.println("[MQTT] Could not add light bar, because too many light bars are saved!");
-        Serial.println("[MQTT] Please check if you actually want to save more than " + String(constants::MAX_LIGHTBARS, DEC) + " light bars.");
-        Serial.println("[MQTT] If you do, increase MAX_LIGHTBARS in constants.h and recompile.");
+        this->stats.publish_failures++;
         return false;
     }
-    this->lightbars[this->lightbarCount] = lightbar;
-    this->lightbarCount++;
-    this->sendHomeAssistantLightbarDiscoveryMessages(lightbar);
+    this->stats.publishes++;
     return true;
 }
 
-bool MQTT::removeLightbar(Lightbar *lightbar)
+// Streams the payload, so it may be larger than the client's buffer.
+bool MQTT::publish(const char *topic, const byte *payload, size_t length, bool retained)
+{
+    if (!this->client->beginPublish(topic, length, retained) || this->client->write(payload, length) != length || !this->client->endPublish())
+    {
+        this->stats.publish_failures++;
+        return false;
+    }
+    this->stats.publishes++;
+    return true;
+}
+
+const MQTTStats &MQTT::getStats()
 {
-    for (int i = 0; i < this->lightbarCount; i++)
+    return this->stats;
+}
+
+void MQTT::handleConnectionEvent(void *mqtt, ConnectionEvent event)
+{
+    MQTT *self = (MQTT *)mqtt;
+    switch (event)
     {
-        if (this->lightbars[i] == lightbar)
+    case EVENT_WIFI_CONNECTED:
+        // Don't keep waiting for a backoff that was caused by the missing network.
+        self->backoff.reset();
+        break;
+    case EVENT_WIFI_DISCONNECTED:
+        if (self->connected)
         {
-            for (int j = i; j < this->lightbarCount - 1; j++)
-            {
-                this->lightbars[j] = this->lightbars[j + 1];
-            }
-            this->lightbarCount--;
-            return true;
+            self->client->disconnect();
+            self->onDisconnected();
         }
+        break;
     }
-    return false;
 }
 
-bool MQTT::addRemote(Remote *remote)
+bool MQTT::addLightbar(Lightbar *lightbar)
 {
-    if (this->remoteCount >= constants::MAX_REMOTES)
+    SerialEntry *entry = this->registry->find(lightbar->getSerial());
+    if (entry == nullptr || entry->lightbar != lightbar)
     {
-        Serial.println("[MQTT] Could not add remote, because too many remotes are saved!");
-        Serial.println("[MQTT] Please check if you actually want to save more than " + String(constants::MAX_REMOTES, DEC) + " remotes.");
-        Serial.println("[MQTT] If you do, increase MAX_REMOTES in constants.h and recompile.");
+        LOG(MQTT, ERROR, "Could not add light bar %s, because it is not known to the radio!", lightbar->getSerialString().c_str());
         return false;
     }
-    this->remotes[this->remoteCount] = remote;
-    this->remoteCount++;
-    remote->registerCommandListener(this->remoteCommandHandler);
-    this->sendHomeAssistantRemoteDiscoveryMessages(remote);
     return true;
 }
 
-bool MQTT::removeRemote(Remote *remote)
+bool MQTT::removeLightbar(Lightbar *lightbar)
+{
+    SerialEntry *entry = this->registry->find(lightbar->getSerial());
+    return entry != nullptr && entry->lightbar == lightbar;
+}
+
+bool MQTT::addRemote(Remote *remote)
 {
-    for (int i = 0; i < this->remoteCount; i++)
+    SerialEntry *entry = this->registry->find(remote->getSerial());
+    if (entry == nullptr || entry->remote != remote)
     {
-        if (this->remotes[i] == remote)
-        {
-            this->remotes[i]->registerCommandListener(this->remoteCommandHandler);
-            for (int j = i; j < this->remoteCount - 1; j++)
-            {
-                this->remotes[j] = this->remotes[j + 1];
-            }
-            this->remoteCount--;
-            return true;
-        }
+        LOG(MQTT, ERROR, "Could not add remote %s, because it is not known to the radio!", remote->getSerialString().c_str());
+        return false;
     }
-    return false;
+    entry->stateTopic = this->getCombinedRootTopic() + "/" + remote->getSerialString() + "/state";
+    entry->actionTopic = this->getCombinedRootTopic() + "/" + remote->getSerialString() + "/action";
+    if (entry->commandListener == Remote::NO_LISTENER)
+        entry->commandListener = remote->registerCommandListener(MQTT::onRemoteCommand, this);
+    return entry->commandListener != Remote::NO_LISTENER;
 }
 
-void MQTT::sendAllHomeAssistantDiscoveryMessages()
+bool MQTT::removeRemote(Remote *remote)
+{
+    SerialEntry *entry = this->registry->find(remote->getSerial());
+    if (entry == nullptr || entry->remote != remote)
+        return false;
+    remote->unregisterCommandListener(entry->commandListener);
+    entry->commandListener = Remote::NO_LISTENER;
+    this->scheduler->cancel(MQTT::endAction, this, remote->getSerial());
+    entry->stateTopic = String();
+    entry->actionTopic = String();
+    entry->turn = RotaryTurn();
+    return true;
+}
+
+void MQTT::startHomeAssistantDiscovery(bool force)
 {
     if (!this->homeAssistantDiscovery)
         return;
-    for (int i = 0; i < this->lightbarCount; i++)
+    if (!this->discoveryCacheLoaded)
     {
-        this->sendHomeAssistantLightbarDiscoveryMessages(this->lightbars[i]);
-    }
-    for (int i = 0; i < this->remoteCount; i++)
-    {
-        this->sendHomeAssistantRemoteDiscoveryMessages(this->remotes[i]);
+        this->discoveryCache.load();
+        this->discoveryCacheLoaded = true;
     }
+
+    // Restarting a job that was interrupted is fine, messages that already went out are skipped.
+    this->forceDiscovery = this->forceDiscovery || force;
+    this->discoveryRunning = true;
+    this->discoverySlot = 0;
+    this->discoveryMessage = 0;
+    this->discoveryMessagesSentBefore = this->discoveryMessagesSent;
+    this->discoveryMessagesSkippedBefore = this->discoveryMessagesSkipped;
+    this->discoveryCache.startJob();
 }
 
-void MQTT::sendHomeAssistantLightbarDiscoveryMessages(Lightbar *lightbar)
+void MQTT::continueHomeAssistantDiscovery()
 {
-    if (!this->homeAssistantDiscovery)
+    if (!this->discoveryRunning)
         return;
 
-    Serial.print("[MQTT] Sending lightbar discovery messages for ");
-    Serial.println(lightbar->getSerialString());
-
-    const String topicClient = this->clientId + "_" + lightbar->getSerialString();
-    const String baseConfig = R"json(
-    "schema": "json",
-    "o": {
-        "name": "lightbar2mqtt",
-        "sw_version": ")json" +
-                              constants::VERSION +
-                              R"json(",
-        "support_url": "https://github.com/ebinf/lightbar2mqtt"
-    },
-    "~": ")json" + this->getCombinedRootTopic() +
-                              "/" +
-                              lightbar->getSerialString() +
-                              R"json(",
-    "availability_topic": ")json" +
-                              this->getCombinedRootTopic() + R"json(/availability",
-    "dev":
+    // Only publish a few messages per loop, so the radio keeps being served and the TCP send buffer
+    // doesn't fill up.
+    unsigned long start = millis();
+    size_t bytes = 0;
+    while (true)
     {
-        "ids" : ")json" + topicClient +
-                              R"json(",
-        "name": ")json" +
-                              lightbar->getName() +
-                              R"json(",
-        "mdl": "Mi Computer Monitor Light Bar (MJGJD01YL)",
-        "mf": "Xiaomi",
-        "sw": "lightbar2mqtt )json" +
-                              constants::VERSION +
-                              R"json(",
-        "sn": ")json" +
-                              lightbar->getSerialString() +
-                              R"json("
-    },)json";
-
-    String rendevous_str = "{" +
-                           baseConfig +
-                           R"json(
-    "supported_color_modes": [
-        "color_temp"
-    ],
-    "brightness": true,
-    "brightness_scale": 15,
-    "name": "Light bar",
-    "cmd_t": "~/command",
-    "uniq_id": ")json" + topicClient +
-                           R"json(_lightbar",
-    "max_mireds": 370,
-    "min_mireds":153,
-    "p": "light",
-    "icon": "mdi:wall-sconce-flat"
-    )json" + "}";
-
-    this->client->beginPublish(String(homeAssistantDiscoveryPrefix + "/light/" + topicClient + "/lightbar/config").c_str(), rendevous_str.length(), true);
-    this->client->print(rendevous_str);
-    this->client->endPublish();
-
-    rendevous_str = "{" +
-                    baseConfig +
-                    R"json(
-    "name": "Pair",
-    "cmd_t": "~/pair",
-    "uniq_id": ")json" +
-                    topicClient + R"json(_pair",
-    "p": "button"
-    )json" + "}";
-    this->client->beginPublish(String(homeAssistantDiscoveryPrefix + "/button/" + topicClient + "/pair/config").c_str(), rendevous_str.length(), true);
-    this->client->print(rendevous_str);
-    this->client->endPublish();
+        if (bytes >= constants::DISCOVERY_BYTES_PER_LOOP || millis() - start >= constants::DISCOVERY_TIME_PER_LOOP)
+            return;
+
+        // The controller's own sensors follow after the last registry slot.
+        if (this->discoverySlot >= this->registry->getSize())
+        {
+            if (!constants::METRICS_DISCOVERY || this->discoveryMessage >= sizeof(DIAGNOSTICS_SENSORS) / sizeof(DIAGNOSTICS_SENSORS[0]))
+                break;
+            bytes += this->sendHomeAssistantDiagnosticsMessage(this->discoveryMessage++);
+            continue;
+        }
+
+        SerialEntry *entry = this->registry->getEntry(this->discoverySlot);
+        if (entry == nullptr || this->discoveryMessage >= MQTT::DISCOVERY_MESSAGES_PER_SERIAL)
+        {
+            this->discoverySlot++;
+            this->discoveryMessage = 0;
+            continue;
+        }
+        bytes += this->sendHomeAssistantDiscoveryMessage(entry, this->discoveryMessage++);
+    }
+
+    this->discoveryRunning = false;
+    this->forceDiscovery = false;
+    this->discoveryCache.finishJob();
+    this->discoveryCache.save();
+
+    LOG(MQTT, INFO, "Discovery messages sent: %u, unchanged and skipped: %u",
+        this->discoveryMessagesSent - this->discoveryMessagesSentBefore,
+        this->discoveryMessagesSkipped - this->discoveryMessagesSkippedBefore);
 }
 
-void MQTT::sendHomeAssistantRemoteDiscoveryMessages(Remote *remote)
+size_t MQTT::sendHomeAssistantDiscoveryMessage(SerialEntry *entry, uint8_t index)
 {
-    if (!this->homeAssistantDiscovery)
-        return;
+    // The first messages of each serial belong to the light bar, the remaining ones to the remote.
+    if (index < MQTT::LIGHTBAR_DISCOVERY_MESSAGES)
+    {
+        Lightbar *lightbar = entry->lightbar;
+        if (lightbar == nullptr)
+            return 0;
+        discovery::Values values = {this->clientId.c_str(), this->combinedRootTopic.c_str(), lightbar->getSerialString().c_str(), lightbar->getName(), discovery::LIGHTBAR_MODEL, nullptr};
+        if (index == 0)
+            return this->sendHomeAssistantDiscoveryMessage("light", "lightbar", discovery::BASE_CONFIG, discovery::LIGHTBAR_CONFIG, values);
+        return this->sendHomeAssistantDiscoveryMessage("button", "pair", discovery::BASE_CONFIG, discovery::PAIR_CONFIG, values);
+    }
 
-    Serial.print("[MQTT] Sending remote discovery messages for ");
-    Serial.println(remote->getSerialString());
-
-    const String topicClient = this->clientId + "_" + remote->getSerialString();
-    const String baseConfig = R"json(
-    "schema": "json",
-    "o": {
-        "name": "lightbar2mqtt",
-        "sw_version": ")json" +
-                              constants::VERSION +
-                              R"json(",
-        "support_url": "https://github.com/ebinf/lightbar2mqtt"
-    },
-    "~": ")json" + this->getCombinedRootTopic() +
-                              "/" +
-                              remote->getSerialString() +
-                              R"json(",
-    "availability_topic": ")json" +
-                              this->getCombinedRootTopic() + R"json(/availability",
-    "dev": {
-        "ids": ")json" + topicClient +
-                              R"json(",
-        "name": ")json" + remote->getName() +
-                              R"json(",
-        "mdl": "Mi Computer Monitor Light Bar Remote Control (MJGJD01YL)",
-        "mf": "Xiaomi",
-        "sw": "lightbar2mqtt )json" +
-                              constants::VERSION +
-                              R"json(",
-        "sn": ")json" + remote->getSerialString() +
-                              R"json("
-    },)json";
-
-    String rendevous_str = "{" +
-                           baseConfig +
-                           R"json(
-    "name": "Remote",
-    "state_topic": "~/state",
-    "uniq_id": ")json" +
-                           topicClient + R"json(_remote",
-    "value_template": "{{ value }}",
-    "enabled_by_default": true,
-    "entity_category": "diagnostic",
-    "icon": "mdi:gesture-double-tap"
-    )json" + "}";
-
-    this->client->beginPublish(String(homeAssistantDiscoveryPrefix + "/sensor/" + topicClient + "/remote/config").c_str(), rendevous_str.length(), true);
-    this->client->print(rendevous_str);
-    this->client->endPublish();
-
-    const char *commands[] = {
-        "press",
-        "turn_clockwise",
-        "turn_counterclockwise",
-        "press_turn_clockwise",
-        "press_turn_counterclockwise",
-        "hold"};
-    String cmd;
-    for (int i = 0; i < 6; i++)
+    index -= MQTT::LIGHTBAR_DISCOVERY_MESSAGES;
+    Remote *remote = entry->remote;
+    if (remote == nullptr)
+        return 0;
+    discovery::Values values = {this->clientId.c_str(), this->combinedRootTopic.c_str(), remote->getSerialString().c_str(), remote->getName(), discovery::REMOTE_MODEL, nullptr};
+    if (index == 0)
+        return this->sendHomeAssistantDiscoveryMessage("sensor", "remote", discovery::BASE_CONFIG, discovery::REMOTE_CONFIG, values);
+
+    values.action = REMOTE_ACTIONS[index - 1];
+    char objectId[40];
+    snprintf(objectId, sizeof(objectId), "action_%s", values.action);
+    return this->sendHomeAssistantDiscoveryMessage("device_automation", objectId, discovery::BASE_CONFIG, discovery::ACTION_CONFIG, values);
+}
+
+size_t MQTT::sendHomeAssistantDiagnosticsMessage(uint8_t index)
+{
+    discovery::Values values = {this->clientId.c_str(), this->combinedRootTopic.c_str(), "diagnostics", "lightbar2mqtt", discovery::DIAGNOSTICS_MODEL, nullptr};
+    return this->sendHomeAssistantDiscoveryMessage("sensor", DIAGNOSTICS_SENSORS[index].objectId, discovery::DIAGNOSTICS_BASE_CONFIG, DIAGNOSTICS_SENSORS[index].config, values);
+}
+
+size_t MQTT::sendHomeAssistantDiscoveryMessage(const char *component, const char *objectId, PGM_P base, PGM_P config, const discovery::Values &values)
+{
+    char topic[160];
+    snprintf(topic, sizeof(topic), "%s/%s/%s_%s/%s/config", this->homeAssistantDiscoveryPrefix.c_str(), component, values.clientId, values.serial, objectId);
+
+    uint32_t topicHash = checksum::fnv1a((const byte *)topic, strlen(topic));
+    uint32_t payloadHash = discovery::hash(config, values, discovery::hash(base, values, checksum::FNV1A_OFFSET));
+    // Looked up even when forced, so the cache learns that the topic is still in use.
+    bool published = this->discoveryCache.isPublished(topicHash, payloadHash);
+    if (!this->forceDiscovery && published)
     {
-        cmd = commands[i];
-        rendevous_str = "{" +
-                        baseConfig +
-                        R"json(
-    "automation_type": "trigger",
-    "payload": ")json" + cmd +
-                        R"json(",
-    "subtype": ")json" + cmd +
-                        R"json(",
-    "type": "action",
-    "topic": "~/state",
-    "p": "device_automation"
-    )json" + "}";
-
-        this->client->beginPublish(String(homeAssistantDiscoveryPrefix + "/device_automation/" + topicClient + "/action_" + cmd + "/config").c_str(), rendevous_str.length(), true);
-        this->client->print(rendevous_str);
-        this->client->endPublish();
+        this->discoveryMessagesSkipped++;
+        return 0;
     }
+
+    // The payload is rendered twice: once to get its length for the MQTT header and once into the client.
+    size_t length = discovery::measure(base, values) + discovery::measure(config, values);
+    // endPublish() cannot tell whether the payload made it out, so the written bytes are counted instead.
+    // A failed publish must not end up in the cache, or it would not be retried.
+    if (!this->client->beginPublish(topic, length, true) ||
+        discovery::render(this->client, base, values) + discovery::render(this->client, config, values) != length ||
+        !this->client->endPublish())
+    {
+        this->stats.publish_failures++;
+        return length;
+    }
+    this->stats.publishes++;
+    this->discoveryMessagesSent++;
+    this->discoveryCache.setPublished(topicHash, payloadHash);
+    return length;
 }
 
 void MQTT::loop()
 {
+    if (!WiFi.isConnected())
+        return;
+
     if (!this->client->connected())
     {
-        Serial.println("[MQTT] connection lost!");
-        this->setup();
+        if (this->connected)
+        {
+            LOG(MQTT, WARNING, "connection lost!");
+            this->onDisconnected();
+        }
+        if (!this->backoff.isDue() || !this->connect())
+            return;
+        this->onConnected();
     }
     this->client->loop();
+
+    if (this->discoveryRequested)
+    {
+        this->discoveryRequested = false;
+        this->startHomeAssistantDiscovery(true);
+    }
+    this->continueHomeAssistantDiscovery();
 }
 
 void MQTT::sendAction(Remote *remote, byte command, byte options)
 {
-    String action;
-    switch ((uint8_t)command)
+    const char *action = actionOf(command);
+    if (action == nullptr)
+        return;
+
+    SerialEntry *entry = this->registry->find(remote->getSerial());
+    if (entry == nullptr)
+        return;
+
+    bool rotary = command == Lightbar::Command::BRIGHTER || command == Lightbar::Command::DIMMER ||
+                  command == Lightbar::Command::WARMER || command == Lightbar::Command::COOLER;
+    uint8_t steps = rotary ? stepsOf(options) : 0;
+    unsigned long now = millis();
+
+    // More steps in the same direction only extend the current turn.
+    if (rotary && entry->turn.steps > 0 && entry->turn.command == command && entry->turn.steps <= 0xFFFF - steps)
     {
-    case Lightbar::Command::ON_OFF:
-        action = "press";
-        break;
+        entry->turn.steps += steps;
+        entry->turn.lastStepAt = now;
+        this->scheduler->schedule(constants::ROTARY_AGGREGATION_WINDOW, MQTT::endAction, this, remote->getSerial());
+        return;
+    }
 
-    case Lightbar::Command::BRIGHTER:
-        action = "turn_clockwise";
-        break;
+    // Anything else ends a turn that is still going on.
+    this->publishTurn(entry);
 
-    case Lightbar::Command::DIMMER:
-        action = "turn_counterclockwise";
-        break;
+    const char *topic = entry->stateTopic.c_str();
+    LOG(MQTT, INFO, "Sending message (%s): %s", topic, action);
+    this->publish(topic, action);
 
-    case Lightbar::Command::WARMER:
-        action = "press_turn_counterclockwise";
-        break;
+    if (rotary)
+    {
+        entry->turn.command = command;
+        entry->turn.steps = steps;
+        entry->turn.firstSteps = steps;
+        entry->turn.startedAt = now;
+        entry->turn.lastStepAt = now;
+    }
 
-    case Lightbar::Command::COOLER:
-        action = "press_turn_clockwise";
-        break;
+    // Further events of the same remote push the reset back, so a turn of the knob ends in a single one.
+    this->scheduler->schedule(rotary ? constants::ROTARY_AGGREGATION_WINDOW : constants::ACTION_CLEAR_DELAY,
+                              MQTT::endAction, this, remote->getSerial());
+}
 
-    case Lightbar::Command::RESET:
-        action = "hold";
-        break;
+void MQTT::onRemoteCommand(void *mqtt, Remote *remote, byte command, byte options)
+{
+    ((MQTT *)mqtt)->sendAction(remote, command, options);
+}
 
-    default:
+void MQTT::endAction(void *mqtt, uint32_t serial)
+{
+    MQTT *self = (MQTT *)mqtt;
+    SerialEntry *entry = self->registry->find(serial);
+    if (entry == nullptr || entry->remote == nullptr)
         return;
-    }
+    self->publishTurn(entry);
+    self->publish(entry->stateTopic.c_str(), NULL);
+}
 
-    String topic = String(this->getCombinedRootTopic() + "/" + remote->getSerialString() + "/state");
-    Serial.print("[MQTT] Sending message (");
-    Serial.print(topic);
-    Serial.print("): ");
-    Serial.println(action);
-    this->client->publish(topic.c_str(), action.c_str());
-    delay(200);
-    this->client->publish(topic.c_str(), NULL);
-}
\ No newline at end of file
+void MQTT::publishTurn(SerialEntry *entry)
+{
+    if (entry->turn.steps == 0)
+        return;
+
+    // The rate is given in steps per second, with one decimal. The duration starts when the first frame's
+    // steps were already made.
+    unsigned long duration = entry->turn.lastStepAt - entry->turn.startedAt;
+    unsigned long rate = duration > 0 ? (entry->turn.steps - entry->turn.firstSteps) * 10000UL / duration : 0;
+
+    char payload[112];
+    snprintf(payload, sizeof(payload), "{\"action\":\"%s\",\"steps\":%u,\"duration\":%lu,\"rate\":%lu.%lu}",
+             actionOf(entry->turn.command), entry->turn.steps, duration, rate / 10, rate % 10);
+    entry->turn = RotaryTurn();
+
+    LOG(MQTT, INFO, "Sending message (%s): %s", entry->actionTopic.c_str(), payload);
+    this->publish(entry->actionTopic.c_str(), payload);
+}
@@ -1,9 +1,14 @@
 #include <PubSubClient.h>
 #include <ESP8266WiFi.h>
 
+#include "connection.h"
 #include "constants.h"
+#include "discovery.h"
+#include "discovery_cache.h"
 #include "lightbar.h"
+#include "registry.h"
 #include "remote.h"
+#include "scheduler.h"
 
 #ifndef MQTT_H
 #define MQTT_H
@@ -11,10 +16,18 @@
 class Remote;
 class Lightbar;
 
+struct MQTTStats
+{
+    uint32_t publishes = 0;
+    uint32_t publish_failures = 0;
+    uint32_t connects = 0;
+    uint32_t connect_failures = 0;
+};
+
 class MQTT
 {
 public:
-    MQTT(WiFiClient *wifiClient, const char *mqttServer, int mqttPort, const char *mqttUser, const char *mqttPassword, const char *mqttRootTopic, bool homeAssistantAutoDiscovery, const char *homeAssistantAutoDiscoveryPrefix);
+    MQTT(Registry *registry, Scheduler *scheduler, WiFiClient *wifiClient, const char *mqttServer, int mqttPort, const char *mqttUser, const char *mqttPassword, const char *mqttRootTopic, bool homeAssistantAutoDiscovery, const char *homeAssistantAutoDiscoveryPrefix);
     ~MQTT();
     void setup();
     void loop();
@@ -26,15 +39,20 @@ public:
     void sendAction(Remote *remote, byte command, byte options);
     const String getCombinedRootTopic();
     const String getClientId();
+    bool isConnected();
+    bool publish(const char *topic, const char *payload, bool retained = false);
+    bool publish(const char *topic, const byte *payload, size_t length, bool retained);
+    const MQTTStats &getStats();
+    static void handleConnectionEvent(void *mqtt, ConnectionEvent event);
+    static void endAction(void *mqtt, uint32_t serial);
+    static void onRemoteCommand(void *mqtt, Remote *remote, byte command, byte options);
 
 private:
     WiFiClient *wifiClient;
     PubSubClient *client;
     String clientId;
-    Lightbar *lightbars[constants::MAX_LIGHTBARS];
-    int lightbarCount = 0;
-    Remote *remotes[constants::MAX_REMOTES];
-    int remoteCount = 0;
+    Registry *registry;
+    Scheduler *scheduler;
     const char *mqttServer;
     int mqttPort = 1883;
     const char *mqttUser = "";
@@ -44,11 +62,38 @@ private:
     String homeAssistantDiscoveryPrefix = "homeassistant";
 
     String combinedRootTopic;
-    std::function<void(Remote *, byte, byte)> remoteCommandHandler;
 
-    void sendAllHomeAssistantDiscoveryMessages();
-    void sendHomeAssistantLightbarDiscoveryMessages(Lightbar *lightbar);
-    void sendHomeAssistantRemoteDiscoveryMessages(Remote *remote);
+    // The broker connection is (re)established by loop() whenever WiFi is up, without waiting in between.
+    Backoff backoff;
+    bool connected = false;
+    MQTTStats stats;
+
+    // Discovery messages are only published if they changed since they were last published, or if
+    // Home Assistant announced that it (re)started. They are sent by a job that loop() advances a few
+    // messages at a time, walking through the registry slot by slot.
+    static const uint8_t LIGHTBAR_DISCOVERY_MESSAGES = 2;
+    static const uint8_t DISCOVERY_MESSAGES_PER_SERIAL = LIGHTBAR_DISCOVERY_MESSAGES + 7;
+    DiscoveryCache discoveryCache;
+    bool discoveryCacheLoaded = false;
+    bool discoveryRequested = false;
+    bool forceDiscovery = false;
+    bool discoveryRunning = false;
+    uint8_t discoverySlot = 0;
+    uint8_t discoveryMessage = 0;
+    uint32_t discoveryMessagesSent = 0;
+    uint32_t discoveryMessagesSkipped = 0;
+    uint32_t discoveryMessagesSentBefore = 0;
+    uint32_t discoveryMessagesSkippedBefore = 0;
+
+    void publishTurn(SerialEntry *entry);
+    bool connect();
+    void onConnected();
+    void onDisconnected();
+    void startHomeAssistantDiscovery(bool force);
+    void continueHomeAssistantDiscovery();
+    size_t sendHomeAssistantDiscoveryMessage(SerialEntry *entry, uint8_t index);
+    size_t sendHomeAssistantDiagnosticsMessage(uint8_t index);
+    size_t sendHomeAssistantDiscoveryMessage(const char *component, const char *objectId, PGM_P base, PGM_P config, const discovery::Values &values);
 };
 
 #endif
\ No newline at end of file
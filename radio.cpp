@@ -1,4 +1,6 @@
 #include "radio.h"
+#include "lightbar.h"
+#include "log.h"
 
 /*
  * Package structure:
@@ -10,135 +12,200 @@
  * 15 – 16: CRC16 checksum
  */
 
-Radio::Radio(uint8_t ce, uint8_t csn)
+constexpr byte Radio::raw_preamble[8] = {rawPreambleByte(0), rawPreambleByte(1), rawPreambleByte(2), rawPreambleByte(3),
+                                         rawPreambleByte(4), rawPreambleByte(5), rawPreambleByte(6), rawPreambleByte(7)};
+
+static_assert((constants::MAX_BUFFERED_PACKAGES & (constants::MAX_BUFFERED_PACKAGES - 1)) == 0 && constants::MAX_BUFFERED_PACKAGES <= 128,
+              "MAX_BUFFERED_PACKAGES must be a power of two, not larger than 128");
+
+Radio::Radio(Registry *registry, uint8_t ce, uint8_t csn, uint8_t irq)
 {
+    this->registry = registry;
     this->radio = RF24(ce, csn);
+    this->irq_pin = irq;
 }
 
 Radio::~Radio()
 {
+    if (this->irq_pin != Radio::NO_IRQ_PIN)
+        detachInterrupt(digitalPinToInterrupt(this->irq_pin));
     this->radio.stopListening();
     this->radio.powerDown();
 }
 
 bool Radio::addRemote(Remote *remote)
 {
-    if (this->num_remotes >= constants::MAX_REMOTES)
-    {
-        Serial.println("[Radio] Could not add remote, because too many remotes are saved!");
-        Serial.println("[Radio] Please check if you actually want to save more than " + String(constants::MAX_REMOTES, DEC) + " remotes.");
-        Serial.println("[Radio] If you do, increase MAX_REMOTES in constants.h and recompile.");
+    if (!this->registry->addRemote(remote))
         return false;
-    }
-    if (this->num_package_ids >= constants::MAX_SERIALS)
-    {
-        Serial.println("[Radio] Could not add remote, because too many serials are saved!");
-        Serial.println("[Radio] Please check if you actually want to save more than " + String(constants::MAX_SERIALS, DEC) + " serials.");
-        Serial.println("[Radio] If you do, increase MAX_SERIALS in constants.h and recompile.");
-        return false;
-    }
-    this->remotes[this->num_remotes] = remote;
-    this->num_remotes++;
-    this->package_ids[this->num_package_ids].serial = remote->getSerial();
-    this->package_ids[this->num_package_ids].package_id = 0;
-    this->num_package_ids++;
-    Serial.print("[Radio] Remote ");
-    Serial.print(remote->getSerialString());
-    Serial.println(" added!");
+    LOG(RADIO, INFO, "Remote %s added!", remote->getSerialString().c_str());
     return true;
 }
 
 bool Radio::removeRemote(Remote *remote)
 {
-    for (int i = 0; i < this->num_remotes; i++)
+    return this->registry->removeRemote(remote);
+}
+
+bool Radio::addLightbar(Lightbar *lightbar)
+{
+    if (!this->registry->addLightbar(lightbar))
+        return false;
+    LOG(RADIO, INFO, "Light bar %s added!", lightbar->getSerialString().c_str());
+    return true;
+}
+
+bool Radio::removeLightbar(Lightbar *lightbar)
+{
+    return this->registry->removeLightbar(lightbar);
+}
+
+const RadioStats &Radio::getStats()
+{
+    return this->stats;
+}
+
+void Radio::resetHistograms()
+{
+    this->stats.command_latency.reset();
+    this->stats.action_latency.reset();
+}
+
+void Radio::setCaptureHandler(PackageHandler handler, void *context)
+{
+    this->captureHandler = handler;
+    this->captureContext = context;
+}
+
+uint8_t Radio::getTransmitQueueLength()
+{
+    return this->tx_queue_length;
+}
+
+uint8_t Radio::getReceiveBufferLength()
+{
+    return this->rx_buffer_write - this->rx_buffer_read;
+}
+
+bool Radio::sendCommand(uint32_t serial, byte command, byte options)
+{
+    SerialEntry *entry = this->registry->find(serial);
+    if (entry == nullptr || entry->lightbar == nullptr)
     {
-        if (this->remotes[i] == remote)
-        {
-            for (int j = 0; j < this->num_package_ids; j++)
-            {
-                if (this->package_ids[j].serial == remote->getSerial())
-                {
-                    for (int k = j; k < this->num_package_ids - 1; k++)
-                    {
-                        this->package_ids[k] = this->package_ids[k + 1];
-                    }
-                    this->num_package_ids--;
-                    break;
-                }
-            }
-
-            for (int j = i; j < this->num_remotes - 1; j++)
-            {
-                this->remotes[j] = this->remotes[j + 1];
-            }
-            this->num_remotes--;
-            return true;
-        }
+        LOG(RADIO, ERROR, "Could not send command, because there is no light bar with serial 0x%06X!", serial);
+        return false;
     }
-    return false;
+    return this->sendCommand(entry->lightbar->getFrameTemplate(), command, options);
 }
 
-void Radio::sendCommand(uint32_t serial, byte command, byte options)
+bool Radio::sendCommand(uint32_t serial, byte command)
 {
-    PackageIdForSerial *package_id = nullptr;
-    for (int i = 0; i < this->num_package_ids; i++)
+    return this->sendCommand(serial, command, 0x0);
+}
+
+bool Radio::sendCommand(FrameTemplate *frame, byte command, byte options)
+{
+    if (this->tx_queue_length >= constants::MAX_QUEUED_FRAMES)
     {
-        if (this->package_ids[i].serial == serial)
-        {
-            package_id = &this->package_ids[i];
-            break;
-        }
+        this->stats.queue_full++;
+        LOG(RADIO, WARNING, "Could not send command, because the transmit queue is full!");
+        return false;
+    }
+
+    QueuedFrame *queued = &this->tx_queue[(this->tx_queue_head + this->tx_queue_length) % constants::MAX_QUEUED_FRAMES];
+    queued->requested_at = frame->requested_at;
+    frame->requested_at = 0;
+
+    byte *data = queued->data;
+    memcpy(data, frame->data, sizeof(frame->data));
+    data[12] = ++frame->sequence;
+    data[13] = command;
+    data[14] = options;
+
+    uint16_t crc = checksum::crc16(data + 12, 3, frame->prefix_crc);
+    data[15] = (crc & 0xFF00) >> 8;
+    data[16] = crc & 0x00FF;
+
+    if (LOG_ENABLED(RADIO, DEBUG))
+    {
+        char hex[2 * sizeof(QueuedFrame::data) + 1];
+        for (size_t i = 0; i < sizeof(QueuedFrame::data); i++)
+            sprintf(hex + 2 * i, "%02X", data[i]);
+        LOG(RADIO, DEBUG, "Queueing command: 0x%s", hex);
     }
-    if (package_id == nullptr)
+
+    this->tx_queue_length++;
+    this->stats.frames_queued++;
+    if (this->tx_queue_length > this->stats.queue_high_water_mark)
+        this->stats.queue_high_water_mark = this->tx_queue_length;
+    return true;
+}
+
+void Radio::prepareFrameTemplate(FrameTemplate *frame, uint32_t serial)
+{
+    memset(frame->data, 0, sizeof(frame->data));
+    memcpy(frame->data, Radio::preamble, sizeof(Radio::preamble));
+    frame->data[8] = (serial & 0xFF0000) >> 16;
+    frame->data[9] = (serial & 0x00FF00) >> 8;
+    frame->data[10] = serial & 0x0000FF;
+    frame->data[11] = 0xFF;
+    frame->prefix_crc = checksum::crc16(frame->data, 12);
+    frame->sequence = 0;
+    frame->requested_at = 0;
+}
+
+void Radio::fetchLightbarCommands()
+{
+    for (int i = 0; i < this->registry->getSize(); i++)
     {
-        if (this->num_package_ids >= constants::MAX_SERIALS)
+        SerialEntry *entry = this->registry->getEntry(this->next_lightbar_slot);
+        this->next_lightbar_slot = (this->next_lightbar_slot + 1) % this->registry->getSize();
+        if (entry != nullptr && entry->lightbar != nullptr && entry->lightbar->hasPendingCommands())
         {
-            Serial.println("[Radio] Could not send command, because too many serials are saved!");
-            Serial.println("[Radio] Please check if you actually want to save more than " + String(constants::MAX_SERIALS, DEC) + " serials.");
-            Serial.println("[Radio] If you do, increase MAX_SERIALS in constants.h and recompile.");
+            entry->lightbar->flushPendingCommands();
             return;
         }
-        package_id = &this->package_ids[this->num_package_ids];
-        package_id->serial = serial;
-        package_id->package_id = 0;
-        this->num_package_ids++;
     }
+}
 
-    byte data[17] = {0};
-    memcpy(data, Radio::preamble, sizeof(Radio::preamble));
-    data[8] = (serial & 0xFF0000) >> 16;
-    data[9] = (serial & 0x00FF00) >> 8;
-    data[10] = serial & 0x0000FF;
-    data[11] = 0xFF;
-    data[12] = ++package_id->package_id;
-    data[13] = command;
-    data[14] = options;
+void Radio::handleTransmitQueue()
+{
+    if (this->tx_queue_length == 0)
+        this->fetchLightbarCommands();
 
-    this->crc.restart();
-    this->crc.add(data, sizeof(data) - 2);
-    uint16_t checksum = this->crc.calc();
-    data[15] = (checksum & 0xFF00) >> 8;
-    data[16] = checksum & 0x00FF;
+    if (this->tx_queue_length == 0)
+        return;
 
-    Serial.print("[Radio] Sending command: 0x");
-    for (int i = 0; i < 17; i++)
+    if (!this->transmitting)
     {
-        Serial.print(data[i], HEX);
+        this->radio.stopListening();
+        this->transmitting = true;
+        this->tx_repeats_left = constants::FRAME_REPEATS;
     }
-    Serial.println();
+    else if (micros() - this->tx_last_write < constants::FRAME_REPEAT_INTERVAL_US)
+        return;
 
-    this->radio.stopListening();
-    for (int i = 0; i < 20; i++)
+    QueuedFrame *frame = &this->tx_queue[this->tx_queue_head];
+    this->radio.write(frame->data, sizeof(frame->data), true);
+    this->tx_last_write = micros();
+    this->stats.transmissions++;
+    if (frame->requested_at != 0)
     {
-        this->radio.write(&data, sizeof(data), true);
-        delay(10);
+        this->stats.command_latency.add(this->tx_last_write - frame->requested_at);
+        frame->requested_at = 0;
     }
-    this->radio.startListening();
-}
+    if (--this->tx_repeats_left > 0)
+        return;
 
-void Radio::sendCommand(uint32_t serial, byte command)
-{
-    return this->sendCommand(serial, command, 0x0);
+    // All repeats of the current frame are on air, continue with the next one.
+    this->stats.frames_sent++;
+    this->tx_queue_head = (this->tx_queue_head + 1) % constants::MAX_QUEUED_FRAMES;
+    this->tx_queue_length--;
+    this->tx_repeats_left = constants::FRAME_REPEATS;
+    if (this->tx_queue_length == 0)
+    {
+        this->radio.startListening();
+        this->transmitting = false;
+    }
 }
 
 void Radio::setup()
@@ -146,14 +213,15 @@ void Radio::setup()
     uint retries = 0;
     while (!this->radio.begin())
     {
-        Serial.println("[Radio] nRF24 not responding! Is it wired correctly?");
+        LOG(RADIO, ERROR, "nRF24 not responding! Is it wired correctly?");
+        logger::flush();
         delay(1000);
         retries++;
         if (retries > 60)
             ESP.restart();
     }
 
-    Serial.println("[Radio] Setting up radio...");
+    LOG(RADIO, INFO, "Setting up radio...");
     this->radio.failureDetected = false;
 
     this->radio.openReadingPipe(0, Radio::address);
@@ -168,101 +236,143 @@ void Radio::setup()
 
     this->radio.openWritingPipe(Radio::address);
 
+    if (this->irq_pin != Radio::NO_IRQ_PIN)
+    {
+        // Only pull the IRQ pin low for received packages, not for sent ones.
+        this->radio.maskIRQ(true, true, false);
+        pinMode(this->irq_pin, INPUT);
+        attachInterruptArg(digitalPinToInterrupt(this->irq_pin), Radio::onInterrupt, this, FALLING);
+        LOG(RADIO, INFO, "Using IRQ pin %u", this->irq_pin);
+    }
+
     this->radio.startListening();
-    Serial.println("[Radio] done!");
+    LOG(RADIO, INFO, "done!");
 }
 
 void Radio::loop()
 {
     if (this->radio.failureDetected)
     {
-        Serial.println("[Radio] Failure detected!");
+        LOG(RADIO, ERROR, "Failure detected!");
+        logger::flush();
         delay(1000);
         this->setup();
         delay(1000);
+        this->transmitting = false;
     }
 
-    if (this->radio.available())
-        this->handlePackage();
+    if (!this->transmitting && (this->irq_pin == Radio::NO_IRQ_PIN || this->irq_pending))
+    {
+        this->irq_pending = false;
+        this->receivePackages();
+    }
+    this->handleTransmitQueue();
+
+    // Decoding and dispatching always happens here and never in the interrupt handler.
+    while (this->rx_buffer_read != this->rx_buffer_write)
+    {
+        RawPackage *package = &this->rx_buffer[this->rx_buffer_read % constants::MAX_BUFFERED_PACKAGES];
+        if (this->captureHandler != nullptr)
+            this->captureHandler(this->captureContext, package);
+        this->handlePackage(package);
+        this->rx_buffer_read = this->rx_buffer_read + 1;
+    }
 }
 
-void Radio::handlePackage()
+void IRAM_ATTR Radio::onInterrupt(void *radio)
 {
-    // Read raw data, append a 5 and shift it. See
-    // https://github.com/lamperez/xiaomi-lightbar-nrf24?tab=readme-ov-file#baseband-packet-format
-    // on why that is necessary.
-    byte raw_data[18] = {0};
-    this->radio.read(&raw_data, sizeof(raw_data));
-    byte data[17] = {0x5};
-    for (int i = 0; i < 17; i++)
+    ((Radio *)radio)->irq_pending = true;
+}
+
+void Radio::receivePackages()
+{
+    // Empty the nRF24's FIFO completely, so it doesn't overflow while the rest of the loop is busy.
+    while (this->radio.available())
     {
-        if (i == 0)
-            data[i] = 0x50 | raw_data[i] >> 5;
-        else
-            data[i] = ((raw_data[i - 1] >> 1) & 0x0F) << 4 | ((raw_data[i - 1] & 0x01) << 3) | raw_data[i] >> 5;
+        uint8_t length = this->rx_buffer_write - this->rx_buffer_read;
+        if (length >= constants::MAX_BUFFERED_PACKAGES)
+        {
+            RawPackage discarded;
+            this->radio.read(discarded.data, sizeof(discarded.data));
+            this->stats.buffer_overflows++;
+            continue;
+        }
+
+        RawPackage *package = &this->rx_buffer[this->rx_buffer_write % constants::MAX_BUFFERED_PACKAGES];
+        memset(package->data, 0, sizeof(package->data));
+        this->radio.read(package->data, sizeof(package->data));
+        package->received_at = micros();
+        this->rx_buffer_write = this->rx_buffer_write + 1;
+        if (length + 1 > this->stats.buffer_high_water_mark)
+            this->stats.buffer_high_water_mark = length + 1;
     }
+}
+
+void Radio::handlePackage(const RawPackage *package)
+{
+    const byte *raw_data = package->data;
+
+    // The raw data is missing a leading 5 and therefore shifted by three bits. See
+    // https://github.com/lamperez/xiaomi-lightbar-nrf24?tab=readme-ov-file#baseband-packet-format
+    // on why that happens.
+    this->stats.packages_received++;
 
-    // Check if preamble matches. Ignore package otherwise.
-    if (memcmp(data, Radio::preamble, sizeof(Radio::preamble)))
+    // Check if preamble matches. Ignore package otherwise. Most noise already fails on the first byte.
+    if (raw_data[0] != Radio::raw_preamble[0] ||
+        memcmp(raw_data + 1, Radio::raw_preamble + 1, sizeof(Radio::raw_preamble) - 2) ||
+        (raw_data[7] & Radio::raw_preamble_last_mask) != Radio::raw_preamble[7])
+    {
+        this->stats.preamble_rejects++;
         return;
+    }
+
+    // The preamble is known to match, so only the remaining bytes need to be realigned.
+    byte data[17];
+    memcpy(data, Radio::preamble, sizeof(Radio::preamble));
+    for (int i = sizeof(Radio::preamble); i < 17; i++)
+        data[i] = (uint16_t)(raw_data[i - 1] << 8 | raw_data[i]) >> 5;
 
     // Make sure the checksum of the package is correct.
-    this->crc.restart();
-    this->crc.add(data, sizeof(data) - 2);
-    uint16_t calculated_checksum = this->crc.calc();
+    uint16_t calculated_checksum = checksum::crc16(data, sizeof(data) - 2);
     uint16_t package_checksum = data[15] << 8 | data[16];
     if (calculated_checksum != package_checksum)
     {
-        Serial.println("[Radio] Ignoring pacakge with wrong checksum!");
+        this->stats.checksum_failures++;
+        LOG(RADIO, DEBUG, "Ignoring package with wrong checksum!");
         return;
     }
 
-    // Check if package is coming from a observed remote.
-    Remote *remote = nullptr;
     uint32_t serial = data[8] << 16 | data[9] << 8 | data[10];
-    for (int i = 0; i < this->num_remotes; i++)
-    {
+    SerialEntry *entry = this->registry->find(serial);
 
-        if (serial == this->remotes[i]->getSerial())
-        {
-            remote = this->remotes[i];
-            break;
-        }
-    }
+    // A remote sharing its serial with a light bar controls that bar directly, so whatever
+    // brightness and color temperature we tracked for it is no longer reliable.
+    if (entry != nullptr && entry->lightbar != nullptr)
+        entry->lightbar->invalidateState();
 
-    if (remote == nullptr)
+    // Check if package is coming from a observed remote.
+    if (entry == nullptr || entry->remote == nullptr)
     {
-        Serial.print("[Radio] Ignoring package with unknown serial: 0x");
-        Serial.print(serial, HEX);
-        Serial.println("");
+        this->stats.unknown_serials++;
+        LOG(RADIO, INFO, "Ignoring package with unknown serial: 0x%06X", serial);
         return;
     }
 
-    // Make sure the same package was not handled before.
-    uint8_t package_id = data[12];
-    PackageIdForSerial *package_id_for_serial = nullptr;
-    for (int i = 0; i < this->num_package_ids; i++)
-    {
-        if (this->package_ids[i].serial == serial)
-        {
-            package_id_for_serial = &this->package_ids[i];
-            break;
-        }
-    }
-    if (package_id_for_serial == nullptr)
+    // Make sure the same package was not handled before. This is the case for most packages, as
+    // remotes repeat each of them many times.
+    if (!entry->packages.accept(data[12]))
     {
-        Serial.print("[Radio] Could not find latest package id for serial 0x");
-        Serial.print(serial, HEX);
-        Serial.println("!");
+        this->stats.duplicates++;
         return;
     }
-    if (package_id <= package_id_for_serial->serial && package_id > package_id_for_serial->serial - 64)
-    {
-        Serial.println("[Radio] Ignoring package with too low package number!");
-        return;
-    }
-    package_id_for_serial->package_id = package_id;
+    this->stats.packages_accepted++;
+
+    // The light bar drops frames whose sequence counter is not ahead of the last one it saw. If it shares
+    // its serial with this remote, our next frame has to continue from the remote's counter.
+    if (entry->lightbar != nullptr)
+        entry->lightbar->getFrameTemplate()->sequence = data[12];
 
-    Serial.println("[Radio] Package received!");
-    remote->callback(data[13], data[14]);
+    LOG(RADIO, DEBUG, "Package received!");
+    entry->remote->callback(data[13], data[14]);
+    this->stats.action_latency.add(micros() - package->received_at);
 }
\ No newline at end of file
@@ -2,47 +2,141 @@
 #define RADIO_H
 
 #include <RF24.h>
-#include <CRC16.h>
 
+#include "checksum.h"
 #include "constants.h"
+#include "histogram.h"
+#include "registry.h"
 #include "remote.h"
 
 class Remote;
+class Lightbar;
 
-struct PackageIdForSerial
+struct QueuedFrame
 {
-    uint32_t serial;
-    uint8_t package_id;
+    byte data[17];
+    unsigned long requested_at;
+};
+
+// A frame with preamble, serial and separator already filled in. Only sequence counter, command and
+// options change from one command to the next, so the checksum of the constant prefix is kept as well.
+struct FrameTemplate
+{
+    byte data[17];
+    uint16_t prefix_crc;
+    uint8_t sequence;
+
+    // When the oldest command not yet queued was requested, in micros(). 0 if there is none.
+    unsigned long requested_at;
+};
+
+struct RawPackage
+{
+    byte data[18];
+    unsigned long received_at;
+};
+
+typedef void (*PackageHandler)(void *context, const RawPackage *package);
+
+struct RadioStats
+{
+    uint32_t packages_received = 0;
+    uint32_t preamble_rejects = 0;
+    uint32_t checksum_failures = 0;
+    uint32_t unknown_serials = 0;
+    uint32_t duplicates = 0;
+    uint32_t packages_accepted = 0;
+    uint32_t buffer_overflows = 0;
+    uint8_t buffer_high_water_mark = 0;
+
+    uint32_t frames_queued = 0;
+    uint32_t frames_sent = 0;
+    uint32_t transmissions = 0;
+    uint32_t queue_full = 0;
+    uint8_t queue_high_water_mark = 0;
+
+    // Time from a command being requested until its first frame went on air, in microseconds.
+    Histogram command_latency;
+
+    // Time from a package being read from the nRF24 until its remote's listeners returned, in
+    // microseconds. For MQTT, this includes publishing the action.
+    Histogram action_latency;
 };
 
 class Radio
 {
 public:
-    Radio(uint8_t ce, uint8_t csn);
+    static const uint8_t NO_IRQ_PIN = 0xFF;
+
+    Radio(Registry *registry, uint8_t ce, uint8_t csn, uint8_t irq = NO_IRQ_PIN);
     ~Radio();
     void setup();
-    void sendCommand(uint32_t serial, byte command, byte options);
-    void sendCommand(uint32_t serial, byte command);
+    bool sendCommand(uint32_t serial, byte command, byte options);
+    bool sendCommand(uint32_t serial, byte command);
+    bool sendCommand(FrameTemplate *frame, byte command, byte options);
+    static void prepareFrameTemplate(FrameTemplate *frame, uint32_t serial);
     void loop();
     bool addRemote(Remote *remote);
     bool removeRemote(Remote *remote);
+    bool addLightbar(Lightbar *lightbar);
+    bool removeLightbar(Lightbar *lightbar);
+    const RadioStats &getStats();
+    void resetHistograms();
+    void setCaptureHandler(PackageHandler handler, void *context);
+    uint8_t getTransmitQueueLength();
+    uint8_t getReceiveBufferLength();
 
 private:
     RF24 radio;
-    PackageIdForSerial package_ids[constants::MAX_SERIALS];
-    uint8_t num_package_ids = 0;
+    uint8_t irq_pin;
+    Registry *registry;
 
-    Remote *remotes[constants::MAX_REMOTES];
-    uint8_t num_remotes = 0;
+    // Light bars keep their pending commands until the transmit queue is empty, so newer
+    // commands can still replace older ones. They are served round-robin by registry slot.
+    uint8_t next_lightbar_slot = 0;
+
+    // Frames are queued by sendCommand() and transmitted by loop(), one repeat at a time.
+    QueuedFrame tx_queue[constants::MAX_QUEUED_FRAMES];
+    uint8_t tx_queue_head = 0;
+    uint8_t tx_queue_length = 0;
+    uint8_t tx_repeats_left = 0;
+    unsigned long tx_last_write = 0;
+    bool transmitting = false;
+
+    // Packages are moved from the nRF24's FIFO into this ring by receivePackages() and decoded afterwards.
+    RawPackage rx_buffer[constants::MAX_BUFFERED_PACKAGES];
+    uint8_t rx_buffer_write = 0;
+    uint8_t rx_buffer_read = 0;
+
+    // Set by the interrupt handler if an IRQ pin is configured, so loop() only talks to the nRF24 when a
+    // package arrived. The handler must not use SPI itself: neither RF24 nor SPI live in IRAM, and the
+    // interrupt may fire while the flash cache is disabled, e.g. during EEPROM.commit().
+    volatile bool irq_pending = false;
 
     static const uint64_t address = 0xAAAAAAAAAAAA;
     static constexpr byte preamble[8] = {0x53, 0x39, 0x14, 0xDD, 0x1C, 0x49, 0x34, 0x12};
 
-    // For details on how these parameters were chosen, see
-    // https://github.com/lamperez/xiaomi-lightbar-nrf24?tab=readme-ov-file#crc-checksum
-    CRC16 crc = CRC16(0x1021, 0xfffe, 0x0000, false, false);
+    // The radio receives every package shifted by three bits (see handlePackage()). This is the
+    // preamble as it appears in the raw payload, so noise can be rejected before realigning anything.
+    // The lower five bits of the last byte already belong to the remote ID.
+    static const byte raw_preamble[8];
+    static constexpr byte raw_preamble_last_mask = 0xE0;
+    static constexpr byte rawPreambleByte(uint8_t i)
+    {
+        return (Radio::preamble[i] << 5 | (i < 7 ? Radio::preamble[i + 1] >> 3 : 0)) & 0xFF;
+    }
+
+    RadioStats stats;
+
+    // Called with every package before it is decoded, see Capture.
+    PackageHandler captureHandler = nullptr;
+    void *captureContext = nullptr;
 
-    void handlePackage();
+    static void IRAM_ATTR onInterrupt(void *radio);
+    void receivePackages();
+    void handlePackage(const RawPackage *package);
+    void handleTransmitQueue();
+    void fetchLightbarCommands();
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,211 @@
+#include "registry.h"
+#include "lightbar.h"
+#include "remote.h"
+#include "log.h"
+
+static_assert((constants::REGISTRY_SIZE & (constants::REGISTRY_SIZE - 1)) == 0 && constants::REGISTRY_SIZE <= 128,
+              "REGISTRY_SIZE must be a power of two, not larger than 128");
+static_assert(constants::REGISTRY_SIZE >= 2 * (constants::MAX_LIGHTBARS + constants::MAX_REMOTES),
+              "REGISTRY_SIZE must be at least twice MAX_LIGHTBARS + MAX_REMOTES");
+
+Registry::Registry()
+{
+    for (int i = 0; i < Registry::SIZE; i++)
+    {
+        this->entries[i].serial = Registry::NO_SERIAL;
+        this->entries[i].remote = nullptr;
+        this->entries[i].lightbar = nullptr;
+        this->entries[i].packages.reset();
+        this->entries[i].commandListener = Remote::NO_LISTENER;
+    }
+}
+
+Registry::~Registry()
+{
+}
+
+uint8_t Registry::slotOf(uint32_t serial)
+{
+    // Fibonacci hashing, the serials themselves are not evenly distributed.
+    return (serial * 2654435769u) >> 24 & (Registry::SIZE - 1);
+}
+
+SerialEntry *Registry::find(uint32_t serial)
+{
+    uint8_t slot = Registry::slotOf(serial);
+    while (this->entries[slot].serial != Registry::NO_SERIAL)
+    {
+        if (this->entries[slot].serial == serial)
+            return &this->entries[slot];
+        slot = (slot + 1) & (Registry::SIZE - 1);
+    }
+    return nullptr;
+}
+
+SerialEntry *Registry::getEntry(uint8_t slot)
+{
+    if (slot >= Registry::SIZE || this->entries[slot].serial == Registry::NO_SERIAL)
+        return nullptr;
+    return &this->entries[slot];
+}
+
+uint8_t Registry::getSize()
+{
+    return Registry::SIZE;
+}
+
+SerialEntry *Registry::findOrInsert(uint32_t serial)
+{
+    uint8_t slot = Registry::slotOf(serial);
+    while (this->entries[slot].serial != Registry::NO_SERIAL)
+    {
+        if (this->entries[slot].serial == serial)
+            return &this->entries[slot];
+        slot = (slot + 1) & (Registry::SIZE - 1);
+    }
+    this->entries[slot].serial = serial;
+    return &this->entries[slot];
+}
+
+void Registry::removeIfUnused(SerialEntry *entry)
+{
+    if (entry->remote != nullptr || entry->lightbar != nullptr)
+        return;
+
+    // Shift following entries back into the gap, so no probe sequence is interrupted.
+    uint8_t gap = entry - this->entries;
+    uint8_t slot = gap;
+    while (true)
+    {
+        slot = (slot + 1) & (Registry::SIZE - 1);
+        if (this->entries[slot].serial == Registry::NO_SERIAL)
+            break;
+        uint8_t home = Registry::slotOf(this->entries[slot].serial);
+        if (((slot - home) & (Registry::SIZE - 1)) >= ((slot - gap) & (Registry::SIZE - 1)))
+        {
+            this->entries[gap] = this->entries[slot];
+            gap = slot;
+        }
+    }
+    this->entries[gap].serial = Registry::NO_SERIAL;
+    this->entries[gap].remote = nullptr;
+    this->entries[gap].lightbar = nullptr;
+    this->entries[gap].packages.reset();
+    this->entries[gap].stateTopic = String();
+    this->entries[gap].actionTopic = String();
+    this->entries[gap].turn = RotaryTurn();
+    this->entries[gap].commandListener = Remote::NO_LISTENER;
+}
+
+bool Registry::addRemote(Remote *remote)
+{
+    if (this->remoteCount >= constants::MAX_REMOTES)
+    {
+        LOG(REGISTRY, ERROR, "Could not add remote, because too many remotes are saved!");
+        LOG(REGISTRY, ERROR, "Please check if you actually want to save more than %u remotes.", constants::MAX_REMOTES);
+        LOG(REGISTRY, ERROR, "If you do, increase MAX_REMOTES in constants.h and recompile.");
+        return false;
+    }
+    SerialEntry *entry = this->findOrInsert(remote->getSerial());
+    if (entry->remote != nullptr)
+    {
+        LOG(REGISTRY, ERROR, "Could not add remote, because its serial %s is already used by another remote!", remote->getSerialString().c_str());
+        return false;
+    }
+    entry->remote = remote;
+    entry->packages.reset();
+    entry->actionTopic = String();
+    entry->turn = RotaryTurn();
+    entry->commandListener = Remote::NO_LISTENER;
+    this->remoteCount++;
+    return true;
+}
+
+bool Registry::removeRemote(Remote *remote)
+{
+    SerialEntry *entry = this->find(remote->getSerial());
+    if (entry == nullptr || entry->remote != remote)
+        return false;
+    // A light bar may keep the entry alive, so nothing of the remote must be left behind for the next one.
+    entry->remote = nullptr;
+    entry->stateTopic = String();
+    entry->actionTopic = String();
+    entry->turn = RotaryTurn();
+    entry->commandListener = Remote::NO_LISTENER;
+    this->remoteCount--;
+    this->removeIfUnused(entry);
+    return true;
+}
+
+bool Registry::addLightbar(Lightbar *lightbar)
+{
+    if (this->lightbarCount >= constants::MAX_LIGHTBARS)
+    {
+        LOG(REGISTRY, ERROR, "Could not add light bar, because too many light bars are saved!");
+        LOG(REGISTRY, ERROR, "Please check if you actually want to save more than %u light bars.", constants::MAX_LIGHTBARS);
+        LOG(REGISTRY, ERROR, "If you do, increase MAX_LIGHTBARS in constants.h and recompile.");
+        return false;
+    }
+    SerialEntry *entry = this->findOrInsert(lightbar->getSerial());
+    if (entry->lightbar != nullptr)
+    {
+        LOG(REGISTRY, ERROR, "Could not add light bar, because its serial %s is already used by another light bar!", lightbar->getSerialString().c_str());
+        return false;
+    }
+    entry->lightbar = lightbar;
+    this->lightbarCount++;
+    return true;
+}
+
+bool Registry::removeLightbar(Lightbar *lightbar)
+{
+    SerialEntry *entry = this->find(lightbar->getSerial());
+    if (entry == nullptr || entry->lightbar != lightbar)
+        return false;
+    entry->lightbar = nullptr;
+    this->lightbarCount--;
+    this->removeIfUnused(entry);
+    return true;
+}
+
+bool ReplayWindow::accept(uint8_t package_id)
+{
+    if (!this->initialized)
+    {
+        this->initialized = true;
+        this->latest = package_id;
+        this->seen = 1;
+        return true;
+    }
+
+    int8_t ahead = (int8_t)(package_id - this->latest);
+    if (ahead > 0)
+    {
+        this->seen = ahead < ReplayWindow::WINDOW ? this->seen << ahead | 1 : 1;
+        this->latest = package_id;
+        return true;
+    }
+
+    uint8_t behind = -ahead;
+    if (behind < ReplayWindow::WINDOW)
+    {
+        uint32_t bit = (uint32_t)1 << behind;
+        if (this->seen & bit)
+            return false;
+        this->seen |= bit;
+        return true;
+    }
+
+    // Far older than anything in the window. Most likely the remote was reset, e.g. by changing
+    // its batteries, so start over from this package.
+    this->latest = package_id;
+    this->seen = 1;
+    return true;
+}
+
+void ReplayWindow::reset()
+{
+    this->initialized = false;
+    this->latest = 0;
+    this->seen = 0;
+}
@@ -0,0 +1,86 @@
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include "constants.h"
+
+class Remote;
+class Lightbar;
+
+// Remembers which of the last WINDOW package ids of a remote have been seen. Remotes send every
+// package 20 times in a row, so this makes sure each button event is only handled once, even if
+// the repeats arrive out of order or the 8-bit package id wraps around.
+struct ReplayWindow
+{
+    static const uint8_t WINDOW = 32;
+
+    bool initialized = false;
+    uint8_t latest = 0;
+    uint32_t seen = 0;
+
+    bool accept(uint8_t package_id);
+    void reset();
+};
+
+// A turn of a remote's knob, made up of all steps in the same direction that arrived within
+// constants::ROTARY_AGGREGATION_WINDOW of each other.
+struct RotaryTurn
+{
+    byte command = 0;
+    uint16_t steps = 0;
+    // The steps of the turn's first frame, made at startedAt.
+    uint16_t firstSteps = 0;
+    unsigned long startedAt = 0;
+    unsigned long lastStepAt = 0;
+};
+
+// Everything the controller knows about one serial. A remote and a light bar may share the same serial.
+struct SerialEntry
+{
+    uint32_t serial;
+    Remote *remote;
+    Lightbar *lightbar;
+
+    // The package ids received from the remote with this serial.
+    ReplayWindow packages;
+
+    // The topics the remote's actions and aggregated turns are published to.
+    String stateTopic;
+    String actionTopic;
+
+    // The turn of the remote's knob that is currently being aggregated.
+    RotaryTurn turn;
+
+    // The handle of MQTT's command listener on the remote, Remote::NO_LISTENER if there is none.
+    int8_t commandListener;
+};
+
+// Maps serials to their entry using open addressing with linear probing. The table is only ever filled
+// to half of its size, so lookups for both known and unknown serials only touch a few slots.
+class Registry
+{
+public:
+    static const uint32_t NO_SERIAL = 0xFFFFFFFF;
+
+    Registry();
+    ~Registry();
+    SerialEntry *find(uint32_t serial);
+    SerialEntry *getEntry(uint8_t slot);
+    uint8_t getSize();
+    bool addRemote(Remote *remote);
+    bool removeRemote(Remote *remote);
+    bool addLightbar(Lightbar *lightbar);
+    bool removeLightbar(Lightbar *lightbar);
+
+private:
+    static const uint8_t SIZE = constants::REGISTRY_SIZE;
+
+    SerialEntry entries[SIZE];
+    uint8_t remoteCount = 0;
+    uint8_t lightbarCount = 0;
+
+    static uint8_t slotOf(uint32_t serial);
+    SerialEntry *findOrInsert(uint32_t serial);
+    void removeIfUnused(SerialEntry *entry);
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include "remote.h"
+#include "log.h"
 
 Remote::Remote(Radio *radio, uint32_t serial, const char *name)
 {
@@ -20,7 +21,7 @@ uint32_t Remote::getSerial()
     return this->serial;
 }
 
-String Remote::getSerialString()
+const String &Remote::getSerialString()
 {
     return this->serialString;
 }
@@ -32,40 +33,36 @@ const char *Remote::getName()
 
 void Remote::callback(byte command, byte options)
 {
-    for (int i = 0; i < this->numCommandListeners; i++)
+    for (int i = 0; i < constants::MAX_COMMAND_LISTENERS; i++)
     {
-        this->commandListeners[i](this, command, options);
+        if (this->commandListeners[i].listener != nullptr)
+            this->commandListeners[i].listener(this->commandListeners[i].context, this, command, options);
     }
 }
 
-bool Remote::registerCommandListener(std::function<void(Remote *, byte, byte)> callback)
+int8_t Remote::registerCommandListener(CommandListener listener, void *context)
 {
-    if (this->numCommandListeners >= constants::MAX_COMMAND_LISTENERS)
+    for (int i = 0; i < constants::MAX_COMMAND_LISTENERS; i++)
     {
-        Serial.println("[Remote] Could not add command listener to remote, because too many are saved!");
-        Serial.println("[Remote] Please check if you actually want to save more than " + String(constants::MAX_COMMAND_LISTENERS, DEC) + " command listeners.");
-        Serial.println("[Remote] If you do, increase MAX_COMMAND_LISTENERS in constants.h and recompile.");
-        return false;
+        if (this->commandListeners[i].listener == nullptr)
+        {
+            this->commandListeners[i].listener = listener;
+            this->commandListeners[i].context = context;
+            return i;
+        }
     }
-    this->commandListeners[this->numCommandListeners] = callback;
-    this->numCommandListeners++;
-    return true;
+
+    LOG(REMOTE, ERROR, "Could not add command listener to remote, because too many are saved!");
+    LOG(REMOTE, ERROR, "Please check if you actually want to save more than %u command listeners.", constants::MAX_COMMAND_LISTENERS);
+    LOG(REMOTE, ERROR, "If you do, increase MAX_COMMAND_LISTENERS in constants.h and recompile.");
+    return Remote::NO_LISTENER;
 }
 
-bool Remote::unregisterCommandListener(std::function<void(Remote *, byte, byte)> callback)
+bool Remote::unregisterCommandListener(int8_t handle)
 {
-    // ESP8266-compatible function comparison
-    for (int i = 0; i < this->numCommandListeners; i++)
-    {
-        if (&this->commandListeners[i] == &callback)
-        {
-            for (int j = i; j < this->numCommandListeners - 1; j++)
-            {
-                this->commandListeners[j] = this->commandListeners[j + 1];
-            }
-            this->numCommandListeners--;
-            return true;
-        }
-    }
-    return false;
-}
\ No newline at end of file
+    if (handle < 0 || handle >= constants::MAX_COMMAND_LISTENERS || this->commandListeners[handle].listener == nullptr)
+        return false;
+    this->commandListeners[handle].listener = nullptr;
+    this->commandListeners[handle].context = nullptr;
+    return true;
+}
@@ -5,19 +5,25 @@
 #include "radio.h"
 
 class Radio;
+class Remote;
+
+typedef void (*CommandListener)(void *context, Remote *remote, byte command, byte options);
 
 class Remote
 {
 public:
+    // Returned by registerCommandListener() if the listener could not be registered.
+    static const int8_t NO_LISTENER = -1;
+
     Remote(Radio *radio, uint32_t serial, const char *name);
     ~Remote();
 
     uint32_t getSerial();
-    String getSerialString();
+    const String &getSerialString();
     const char *getName();
 
-    bool registerCommandListener(std::function<void(Remote *, byte, byte)> callback);
-    bool unregisterCommandListener(std::function<void(Remote *, byte, byte)> callback);
+    int8_t registerCommandListener(CommandListener listener, void *context);
+    bool unregisterCommandListener(int8_t handle);
 
     void callback(byte command, byte options);
 
@@ -27,8 +33,14 @@ private:
     const char *name;
     String serialString;
 
-    std::function<void(Remote *, byte, byte)> commandListeners[constants::MAX_COMMAND_LISTENERS];
-    uint8_t numCommandListeners = 0;
+    // A listener's handle is the index of its slot, so it stays valid until the listener is unregistered.
+    // Free slots have no listener.
+    struct ListenerSlot
+    {
+        CommandListener listener = nullptr;
+        void *context = nullptr;
+    };
+    ListenerSlot commandListeners[constants::MAX_COMMAND_LISTENERS];
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,67 @@
+#include "scheduler.h"
+#include "log.h"
+
+Scheduler::Scheduler()
+{
+}
+
+Scheduler::~Scheduler()
+{
+}
+
+bool Scheduler::schedule(unsigned long delay, TaskFunction function, void *context, uint32_t key)
+{
+    int index = this->find(function, context, key);
+    if (index < 0)
+    {
+        if (this->length >= constants::MAX_SCHEDULED_TASKS)
+        {
+            LOG(SCHEDULER, ERROR, "Could not schedule task, because there are too many tasks!");
+            return false;
+        }
+        index = this->length++;
+        this->tasks[index].function = function;
+        this->tasks[index].context = context;
+        this->tasks[index].key = key;
+    }
+    this->tasks[index].due = millis() + delay;
+    return true;
+}
+
+bool Scheduler::cancel(TaskFunction function, void *context, uint32_t key)
+{
+    int index = this->find(function, context, key);
+    if (index < 0)
+        return false;
+    this->tasks[index] = this->tasks[--this->length];
+    return true;
+}
+
+void Scheduler::loop()
+{
+    unsigned long now = millis();
+    uint8_t i = 0;
+    while (i < this->length)
+    {
+        if ((long)(now - this->tasks[i].due) < 0)
+        {
+            i++;
+            continue;
+        }
+
+        // Remove the task before running it, so it can schedule itself again.
+        Task task = this->tasks[i];
+        this->tasks[i] = this->tasks[--this->length];
+        task.function(task.context, task.key);
+    }
+}
+
+int Scheduler::find(TaskFunction function, void *context, uint32_t key)
+{
+    for (uint8_t i = 0; i < this->length; i++)
+    {
+        if (this->tasks[i].function == function && this->tasks[i].context == context && this->tasks[i].key == key)
+            return i;
+    }
+    return -1;
+}
@@ -0,0 +1,36 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <Arduino.h>
+
+#include "constants.h"
+
+typedef void (*TaskFunction)(void *context, uint32_t key);
+
+// Runs functions after a delay without blocking the loop. A task is identified by its function,
+// context and key, so scheduling the same task again moves it instead of adding a second one.
+class Scheduler
+{
+public:
+    Scheduler();
+    ~Scheduler();
+    bool schedule(unsigned long delay, TaskFunction function, void *context, uint32_t key);
+    bool cancel(TaskFunction function, void *context, uint32_t key);
+    void loop();
+
+private:
+    struct Task
+    {
+        TaskFunction function;
+        void *context;
+        uint32_t key;
+        unsigned long due;
+    };
+
+    Task tasks[constants::MAX_SCHEDULED_TASKS];
+    uint8_t length = 0;
+
+    int find(TaskFunction function, void *context, uint32_t key);
+};
+
+#endif